@@ -0,0 +1,493 @@
+/*
+ File: BrickedVolume.cpp
+ Created on: 18/10/2026
+ Author: agent
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Project
+#include "BrickedVolume.h"
+#include "Utils.h"
+
+// VTK
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <vtkVolume.h>
+#include <vtkVolumeProperty.h>
+#include <vtkFixedPointVolumeRayCastMapper.h>
+#include <vtkRenderer.h>
+#include <vtkCamera.h>
+#include <vtkMatrix4x4.h>
+#include <vtkCallbackCommand.h>
+#include <vtkCullerCollection.h>
+#include <vtkFrustumCoverageCuller.h>
+#include <vtkMath.h>
+
+// Qt
+#include <QFile>
+#include <QPair>
+#include <QSaveFile>
+#include <QDebug>
+
+// C++
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+  const char    MAGIC[8] = {'V','T','K','M','R','B','V','\0'};
+  const quint32 VERSION  = 2;
+
+  /** \brief Bricked file header, followed by the values histogram, the brick table and the bricks voxels aligned
+   * to the page size.
+   *
+   */
+  struct Header
+  {
+    char    magic[8];      /** file identifier.               */
+    quint32 version;       /** format version.                */
+    quint32 brickSize;     /** side of the bricks.            */
+    qint64  dimensions[3]; /** volume dimensions.             */
+    double  spacing[3];    /** voxel spacing.                 */
+    double  origin[3];     /** volume origin.                 */
+    qint32  scalarType;    /** voxels scalar type.            */
+    qint32  components;    /** voxels components.             */
+    qint64  bricks;        /** number of bricks.              */
+    double  minimum;       /** minimum value.                 */
+    double  maximum;       /** maximum value.                 */
+    double  first;         /** lower value of the first bin.  */
+    double  binWidth;      /** width of each histogram bin.   */
+    qint64  bins;          /** number of histogram bins.      */
+  };
+
+  /** \brief Brick table entry.
+   *
+   */
+  struct BrickEntry
+  {
+    qint32 extent[6]; /** extent of the brick in the volume. */
+    qint64 offset;    /** offset of the voxels in the file.  */
+    qint64 size;      /** size of the voxels in bytes.       */
+  };
+
+  /** \brief Returns the given offset aligned to the page size, so each brick can be mapped on its own.
+   * \param[in] offset file offset.
+   *
+   */
+  inline qint64 pageAligned(const qint64 offset)
+  { return (offset + 4095) & ~static_cast<qint64>(4095); }
+}
+
+//--------------------------------------------------------------------
+bool BrickedVolume::write(vtkImageData *image, const QString &filename, const int brickSize)
+{
+  if(!image || !image->GetPointData()->GetScalars() || brickSize < 2) return false;
+
+  auto scalars = image->GetPointData()->GetScalars();
+
+  Header header;
+  std::memset(&header, 0, sizeof(Header));
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version    = VERSION;
+  header.brickSize  = brickSize;
+  header.scalarType = scalars->GetDataType();
+  header.components = scalars->GetNumberOfComponents();
+  image->GetSpacing(header.spacing);
+  image->GetOrigin(header.origin);
+
+  // the voxels aren't read when rendering, the statistics for the transfer functions are computed now.
+  const auto statistics = imageStatistics(image, false);
+  header.minimum  = statistics.min;
+  header.maximum  = statistics.max;
+  header.first    = statistics.first;
+  header.binWidth = statistics.binWidth;
+  header.bins     = statistics.histogram.size();
+
+  const qint64 histogramSize = header.bins * sizeof(unsigned long long);
+
+  int extent[6];
+  image->GetExtent(extent);
+  for(int i: {0,1,2}) header.dimensions[i] = extent[2*i+1] - extent[2*i] + 1;
+
+  // bricks share the border voxels.
+  const auto voxelSize = static_cast<qint64>(scalars->GetDataTypeSize()) * header.components;
+  const int  step      = brickSize - 1;
+
+  QList<BrickEntry> entries;
+  for(int z = extent[4]; z < extent[5] || z == extent[4]; z += step)
+  {
+    for(int y = extent[2]; y < extent[3] || y == extent[2]; y += step)
+    {
+      for(int x = extent[0]; x < extent[1] || x == extent[0]; x += step)
+      {
+        BrickEntry entry;
+        entry.extent[0] = x; entry.extent[1] = std::min(x + step, extent[1]);
+        entry.extent[2] = y; entry.extent[3] = std::min(y + step, extent[3]);
+        entry.extent[4] = z; entry.extent[5] = std::min(z + step, extent[5]);
+        entry.size      = voxelSize * (entry.extent[1] - entry.extent[0] + 1) * (entry.extent[3] - entry.extent[2] + 1) * (entry.extent[5] - entry.extent[4] + 1);
+        entries << entry;
+      }
+    }
+  }
+
+  header.bricks = entries.size();
+  auto offset   = pageAligned(sizeof(Header) + histogramSize + entries.size() * sizeof(BrickEntry));
+  for(auto &entry: entries)
+  {
+    entry.offset = offset;
+    offset = pageAligned(offset + entry.size);
+  }
+
+  QSaveFile file{filename};
+  if(!file.open(QIODevice::WriteOnly)) return false;
+
+  auto result = file.write(reinterpret_cast<const char *>(&header), sizeof(Header)) == sizeof(Header);
+  result &= file.write(reinterpret_cast<const char *>(statistics.histogram.data()), histogramSize) == histogramSize;
+  for(const auto &entry: entries)
+  {
+    result &= file.write(reinterpret_cast<const char *>(&entry), sizeof(BrickEntry)) == sizeof(BrickEntry);
+  }
+
+  for(const auto &entry: entries)
+  {
+    if(!result) break;
+
+    if(file.pos() < entry.offset)
+    {
+      QByteArray padding(entry.offset - file.pos(), '\0');
+      result &= file.write(padding) == padding.size();
+    }
+
+    // voxels are written row by row.
+    const qint64 rowSize = voxelSize * (entry.extent[1] - entry.extent[0] + 1);
+    for(int z = entry.extent[4]; z <= entry.extent[5] && result; ++z)
+    {
+      for(int y = entry.extent[2]; y <= entry.extent[3] && result; ++y)
+      {
+        auto row = static_cast<const char *>(image->GetScalarPointer(entry.extent[0], y, z));
+        result &= file.write(row, rowSize) == rowSize;
+      }
+    }
+  }
+
+  if(!result)
+  {
+    qDebug() << "BrickedVolume - can't write" << filename;
+    file.cancelWriting();
+  }
+
+  return file.commit() && result;
+}
+
+//--------------------------------------------------------------------
+BrickedVolume::BrickedVolume(const QString &filename, const unsigned long long budget)
+: m_filename  {filename}
+, m_scalarType{0}
+, m_components{0}
+, m_budget    {budget}
+, m_resident  {0}
+, m_renders   {0}
+, m_skipped   {0}
+, m_renderer  {nullptr}
+, m_observer  {0}
+{
+  m_command = vtkSmartPointer<vtkCallbackCommand>::New();
+  m_command->SetClientData(this);
+  m_command->SetCallback(onStartEvent);
+
+  QFile file{filename};
+  if(!file.open(QIODevice::ReadOnly)) return;
+
+  Header header;
+  if(file.read(reinterpret_cast<char *>(&header), sizeof(Header)) != sizeof(Header) ||
+     std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+     header.bins < 0 || header.bins * static_cast<qint64>(sizeof(unsigned long long)) > file.size())
+  {
+    qDebug() << "BrickedVolume - invalid file" << filename;
+    return;
+  }
+
+  std::memcpy(m_spacing, header.spacing, sizeof(m_spacing));
+  std::memcpy(m_origin, header.origin, sizeof(m_origin));
+  m_scalarType = header.scalarType;
+  m_components = header.components;
+
+  m_statistics.min      = header.minimum;
+  m_statistics.max      = header.maximum;
+  m_statistics.first    = header.first;
+  m_statistics.binWidth = header.binWidth;
+  m_statistics.histogram.assign(header.bins, 0);
+
+  const qint64 histogramSize = m_statistics.histogram.size() * sizeof(unsigned long long);
+  if(file.read(reinterpret_cast<char *>(m_statistics.histogram.data()), histogramSize) != histogramSize)
+  {
+    qDebug() << "BrickedVolume - invalid histogram" << filename;
+    return;
+  }
+
+  QList<Brick> bricks;
+  for(qint64 i = 0; i < header.bricks; ++i)
+  {
+    BrickEntry entry;
+    if(file.read(reinterpret_cast<char *>(&entry), sizeof(BrickEntry)) != sizeof(BrickEntry) ||
+       entry.offset + entry.size > file.size())
+    {
+      qDebug() << "BrickedVolume - invalid brick table" << filename;
+      return;
+    }
+
+    auto mapper = vtkSmartPointer<vtkFixedPointVolumeRayCastMapper>::New();
+
+    Brick brick;
+    std::copy(entry.extent, entry.extent + 6, brick.extent);
+    brick.offset   = entry.offset;
+    brick.size     = entry.size;
+    brick.volume   = vtkSmartPointer<vtkVolume>::New();
+    brick.image    = nullptr;
+    brick.lastUsed = 0;
+    brick.volume->SetMapper(mapper);
+    brick.volume->VisibilityOff();
+
+    bricks << brick;
+  }
+
+  m_bricks = bricks;
+}
+
+//--------------------------------------------------------------------
+BrickedVolume::~BrickedVolume()
+{
+  detach();
+
+  for(auto &brick: m_bricks) evict(brick);
+}
+
+//--------------------------------------------------------------------
+QList<vtkSmartPointer<vtkVolume>> BrickedVolume::volumes() const
+{
+  QList<vtkSmartPointer<vtkVolume>> result;
+  for(const auto &brick: m_bricks) result << brick.volume;
+
+  return result;
+}
+
+//--------------------------------------------------------------------
+void BrickedVolume::setProperty(vtkVolumeProperty *property)
+{
+  for(auto &brick: m_bricks) brick.volume->SetProperty(property);
+}
+
+//--------------------------------------------------------------------
+void BrickedVolume::setBlendMode(const int mode)
+{
+  for(auto &brick: m_bricks)
+  {
+    auto mapper = vtkFixedPointVolumeRayCastMapper::SafeDownCast(brick.volume->GetMapper());
+    if(mapper) mapper->SetBlendMode(mode);
+  }
+}
+
+//--------------------------------------------------------------------
+void BrickedVolume::attach(vtkRenderer *renderer)
+{
+  detach();
+  if(!renderer) return;
+
+  m_renderer = renderer;
+  m_observer = renderer->AddObserver(vtkCommand::StartEvent, m_command);
+  m_skipped  = 0;
+
+  for(auto &brick: m_bricks) renderer->AddVolume(brick.volume);
+
+  // bricks don't overlap, so sorting them by distance composites them correctly.
+  auto cullers = renderer->GetCullers();
+  cullers->InitTraversal();
+  while(auto culler = cullers->GetNextItem())
+  {
+    auto frustumCuller = vtkFrustumCoverageCuller::SafeDownCast(culler);
+    if(frustumCuller) frustumCuller->SetSortingStyleToBackToFront();
+  }
+}
+
+//--------------------------------------------------------------------
+void BrickedVolume::detach()
+{
+  if(!m_renderer) return;
+
+  m_renderer->RemoveObserver(m_observer);
+  for(auto &brick: m_bricks) m_renderer->RemoveVolume(brick.volume);
+
+  m_renderer = nullptr;
+}
+
+//--------------------------------------------------------------------
+void BrickedVolume::update(vtkRenderer *renderer)
+{
+  if(!renderer || !renderer->GetActiveCamera() || m_bricks.isEmpty()) return;
+
+  ++m_renders;
+
+  auto camera = renderer->GetActiveCamera();
+  double planes[24];
+  camera->GetFrustumPlanes(renderer->GetTiledAspectRatio(), planes);
+
+  double eye[3];
+  camera->GetPosition(eye);
+
+  // visible bricks, nearest first so they get the budget.
+  QList<QPair<double, int>> visible;
+  for(int i = 0; i < m_bricks.size(); ++i)
+  {
+    if(!isInside(m_bricks[i], planes)) continue;
+
+    double center[3];
+    brickCenter(m_bricks[i], center);
+    visible << qMakePair(vtkMath::Distance2BetweenPoints(eye, center), i);
+  }
+  std::sort(visible.begin(), visible.end());
+
+  int skipped = 0;
+  for(const auto &item: visible)
+  {
+    auto &brick = m_bricks[item.second];
+    brick.lastUsed = m_renders;
+
+    if(brick.image) continue;
+
+    // make room releasing the least recently used bricks outside the view.
+    while(m_resident + brick.size > m_budget)
+    {
+      int lru = -1;
+      for(int i = 0; i < m_bricks.size(); ++i)
+      {
+        const auto &candidate = m_bricks[i];
+        if(!candidate.image || candidate.lastUsed == m_renders) continue;
+        if(lru == -1 || candidate.lastUsed < m_bricks[lru].lastUsed) lru = i;
+      }
+
+      if(lru == -1) break;
+
+      evict(m_bricks[lru]);
+    }
+
+    if(m_resident + brick.size > m_budget || !page(brick)) ++skipped;
+  }
+
+  // only logged when it changes, this is called before every render.
+  if(skipped != m_skipped && skipped > 0)
+  {
+    qDebug() << "BrickedVolume -" << skipped << "visible bricks don't fit in the memory budget of" << m_filename;
+  }
+
+  m_skipped = skipped;
+
+  for(auto &brick: m_bricks)
+  {
+    brick.volume->SetVisibility(brick.image && brick.lastUsed == m_renders);
+  }
+}
+
+//--------------------------------------------------------------------
+bool BrickedVolume::page(Brick &brick)
+{
+  const vtkIdType tuples = static_cast<vtkIdType>(brick.extent[1] - brick.extent[0] + 1) *
+                           (brick.extent[3] - brick.extent[2] + 1) * (brick.extent[5] - brick.extent[4] + 1);
+
+  auto scalars = mapArray(m_filename, brick.offset, m_scalarType, m_components, tuples);
+  if(!scalars) return false;
+
+  auto image = vtkSmartPointer<vtkImageData>::New();
+  image->SetExtent(brick.extent);
+  image->SetSpacing(m_spacing);
+  image->SetOrigin(m_origin);
+  image->GetPointData()->SetScalars(scalars);
+
+  auto mapper = vtkFixedPointVolumeRayCastMapper::SafeDownCast(brick.volume->GetMapper());
+  mapper->SetInputData(image);
+
+  brick.image = image;
+  m_resident += brick.size;
+
+  return true;
+}
+
+//--------------------------------------------------------------------
+void BrickedVolume::evict(Brick &brick)
+{
+  if(!brick.image) return;
+
+  // the mapping is released with the last reference to the voxels.
+  auto mapper = vtkFixedPointVolumeRayCastMapper::SafeDownCast(brick.volume->GetMapper());
+  mapper->RemoveAllInputConnections(0);
+  brick.volume->VisibilityOff();
+
+  brick.image = nullptr;
+  m_resident -= brick.size;
+}
+
+//--------------------------------------------------------------------
+bool BrickedVolume::isInside(const Brick &brick, const double planes[24]) const
+{
+  auto matrix = brick.volume->GetMatrix();
+
+  double corners[8][3];
+  for(int i = 0; i < 8; ++i)
+  {
+    double point[4]{m_origin[0] + brick.extent[0 + (i & 1)] * m_spacing[0],
+                    m_origin[1] + brick.extent[2 + ((i >> 1) & 1)] * m_spacing[1],
+                    m_origin[2] + brick.extent[4 + ((i >> 2) & 1)] * m_spacing[2],
+                    1.};
+    matrix->MultiplyPoint(point, point);
+    std::copy(point, point + 3, corners[i]);
+  }
+
+  // outside if all the corners are outside of any of the planes.
+  for(int p = 0; p < 6; ++p)
+  {
+    const auto plane = planes + 4*p;
+
+    int outside = 0;
+    for(int i = 0; i < 8; ++i)
+    {
+      if(plane[0] * corners[i][0] + plane[1] * corners[i][1] + plane[2] * corners[i][2] + plane[3] < 0) ++outside;
+    }
+
+    if(outside == 8) return false;
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------
+void BrickedVolume::brickCenter(const Brick &brick, double center[3]) const
+{
+  double point[4]{m_origin[0] + (brick.extent[0] + brick.extent[1]) * m_spacing[0] / 2.,
+                  m_origin[1] + (brick.extent[2] + brick.extent[3]) * m_spacing[1] / 2.,
+                  m_origin[2] + (brick.extent[4] + brick.extent[5]) * m_spacing[2] / 2.,
+                  1.};
+
+  brick.volume->GetMatrix()->MultiplyPoint(point, point);
+  std::copy(point, point + 3, center);
+}
+
+//--------------------------------------------------------------------
+void BrickedVolume::onStartEvent(vtkObject *caller, unsigned long eventId, void *clientData, void *callData)
+{
+  auto volume   = static_cast<BrickedVolume *>(clientData);
+  auto renderer = vtkRenderer::SafeDownCast(caller);
+
+  if(volume && renderer) volume->update(renderer);
+}
@@ -0,0 +1,198 @@
+/*
+ File: BrickedVolume.h
+ Created on: 18/10/2026
+ Author: agent
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BRICKEDVOLUME_H_
+#define BRICKEDVOLUME_H_
+
+// Project
+#include "Utils.h"
+
+// VTK
+#include <vtkSmartPointer.h>
+
+// Qt
+#include <QList>
+#include <QString>
+
+class vtkImageData;
+class vtkVolume;
+class vtkVolumeProperty;
+class vtkRenderer;
+class vtkCallbackCommand;
+class vtkObject;
+
+/** \class BrickedVolume
+ * \brief Volume stored on disk as bricks that are mapped in memory on demand, so volumes larger than the
+ * available memory can be rendered. Each brick is rendered by its own vtkVolume and the bricks inside the view
+ * frustum are mapped before each render, nearest first, while the resident size fits in the memory budget. When
+ * the budget is exceeded the least recently used bricks outside the view are released. Bricks share their border
+ * voxels so the interpolation is continuous across them.
+ *
+ */
+class BrickedVolume
+{
+  public:
+    /** \brief Writes the given image in the bricked format. Returns true on success and false otherwise.
+     * \param[in] image image to write.
+     * \param[in] filename bricked file name.
+     * \param[in] brickSize number of voxels of the side of the bricks.
+     *
+     */
+    static bool write(vtkImageData *image, const QString &filename, const int brickSize = 128);
+
+    /** \brief BrickedVolume class constructor. Reads the brick table of the given file, no voxel data is read.
+     * \param[in] filename bricked file name.
+     * \param[in] budget maximum size of the mapped bricks in bytes.
+     *
+     */
+    explicit BrickedVolume(const QString &filename, const unsigned long long budget);
+
+    /** \brief BrickedVolume class destructor.
+     *
+     */
+    ~BrickedVolume();
+
+    /** \brief Returns true if the file has been read correctly and false otherwise.
+     *
+     */
+    bool isValid() const
+    { return !m_bricks.isEmpty(); }
+
+    /** \brief Returns the volumes of the bricks, all use the same property.
+     *
+     */
+    QList<vtkSmartPointer<vtkVolume>> volumes() const;
+
+    /** \brief Sets the property of the volumes of the bricks.
+     * \param[in] property volume property.
+     *
+     */
+    void setProperty(vtkVolumeProperty *property);
+
+    /** \brief Sets the blend mode of the mappers of the bricks.
+     * \param[in] mode vtkVolumeMapper blend mode.
+     *
+     */
+    void setBlendMode(const int mode);
+
+    /** \brief Sets the maximum size of the mapped bricks.
+     * \param[in] budget memory budget in bytes.
+     *
+     */
+    void setBudget(const unsigned long long budget)
+    { m_budget = budget; }
+
+    /** \brief Returns the size of the mapped bricks in bytes.
+     *
+     */
+    unsigned long long residentSize() const
+    { return m_resident; }
+
+    /** \brief Returns the scalar type of the voxels.
+     *
+     */
+    int scalarType() const
+    { return m_scalarType; }
+
+    /** \brief Returns the statistics of the voxels values, computed when the file was written.
+     *
+     */
+    const ImageStatistics &statistics() const
+    { return m_statistics; }
+
+    /** \brief Adds the volumes of the bricks to the given renderer and updates the resident bricks before each
+     * render. The renderer is set to render the volumes back to front.
+     * \param[in] renderer renderer to add the volumes to.
+     *
+     */
+    void attach(vtkRenderer *renderer);
+
+    /** \brief Removes the volumes of the bricks from the renderer they were attached to.
+     *
+     */
+    void detach();
+
+    /** \brief Maps the bricks inside the view frustum of the given renderer and hides the rest.
+     * \param[in] renderer renderer about to render the volumes.
+     *
+     */
+    void update(vtkRenderer *renderer);
+
+  private:
+    /** \brief Brick on disk and its volume.
+     *
+     */
+    struct Brick
+    {
+      int                           extent[6]; /** extent of the brick in the volume.         */
+      qint64                        offset;    /** offset of the voxels in the file.          */
+      qint64                        size;      /** size of the voxels in bytes.               */
+      vtkSmartPointer<vtkVolume>    volume;    /** brick volume.                              */
+      vtkSmartPointer<vtkImageData> image;     /** mapped brick voxels or nullptr if evicted. */
+      unsigned long long            lastUsed;  /** update count when it was last visible.     */
+    };
+
+    /** \brief Maps the voxels of the given brick. Returns true on success and false otherwise.
+     * \param[in] brick brick to map.
+     *
+     */
+    bool page(Brick &brick);
+
+    /** \brief Releases the voxels of the given brick.
+     * \param[in] brick brick to release.
+     *
+     */
+    void evict(Brick &brick);
+
+    /** \brief Returns true if the given brick intersects the frustum defined by the given planes.
+     * \param[in] brick brick to test.
+     * \param[in] planes frustum planes in world coordinates, normals pointing inward.
+     *
+     */
+    bool isInside(const Brick &brick, const double planes[24]) const;
+
+    /** \brief Computes the world position of the center of the given brick.
+     * \param[in] brick brick.
+     * \param[out] center brick center.
+     *
+     */
+    void brickCenter(const Brick &brick, double center[3]) const;
+
+    /** \brief Start render event callback, updates the resident bricks.
+     *
+     */
+    static void onStartEvent(vtkObject *caller, unsigned long eventId, void *clientData, void *callData);
+
+    QString                             m_filename;   /** bricked file name.                      */
+    QList<Brick>                        m_bricks;     /** bricks of the volume.                   */
+    double                              m_spacing[3]; /** voxel spacing.                          */
+    double                              m_origin[3];  /** volume origin.                          */
+    int                                 m_scalarType; /** voxels scalar type.                     */
+    int                                 m_components; /** voxels number of components.            */
+    ImageStatistics                     m_statistics; /** voxels values statistics.               */
+    unsigned long long                  m_budget;     /** memory budget of the mapped bricks.     */
+    unsigned long long                  m_resident;   /** size of the mapped bricks.              */
+    unsigned long long                  m_renders;    /** number of updates, used as LRU clock.   */
+    int                                 m_skipped;    /** bricks skipped in the last update.      */
+    vtkRenderer                        *m_renderer;   /** renderer attached to or nullptr.        */
+    vtkSmartPointer<vtkCallbackCommand> m_command;    /** start render event observer.            */
+    unsigned long                       m_observer;   /** observer tag in the attached renderer.  */
+};
+
+#endif // BRICKEDVOLUME_H_
@@ -19,6 +19,7 @@
 
 // Project
 #include "MovieRenderer.h"
+#include "ResourceRegistry.h"
 
 // Qt
 #include <QDir>
@@ -28,6 +29,7 @@
 #include <QObject>
 #include <QEvent>
 #include <QTimer>
+#include <QElapsedTimer>
 #include <QSettings>
 #include <QDebug>
 
@@ -42,10 +44,26 @@
 #include <vtkPNGWriter.h>
 #include <vtkAxesActor.h>
 #include <vtkOrientationMarkerWidget.h>
+#include <vtkImageData.h>
+#include <vtkCallbackCommand.h>
+#include <vtkVolumeCollection.h>
+#include <vtkVolume.h>
+#include <vtkFixedPointVolumeRayCastMapper.h>
+#include <vtkAbstractVolumeMapper.h>
+#include <vtkActor2D.h>
+#include <vtkActor2DCollection.h>
+#include <vtkMapper2D.h>
+#include <vtkPropCollection.h>
+#include <vtkRendererCollection.h>
+#include <vtkScalarBarActor.h>
+#include <vtkScalarsToColors.h>
+#include <vtkTextActor.h>
+#include <vtkTextProperty.h>
 
 // C++
 #include <chrono>
 #include <thread>
+#include <limits>
 
 const QString VIDEO_4K_ENABLED         = "Video 4k enabled";
 const QString VIDEO_HD_ENABLED         = "Video HD enabled";
@@ -58,6 +76,25 @@ const QString MOTION_BLUR_ENABLED      = "Motion blur enabled";
 const QString MOTION_BLUR_FRAMES       = "Motion blur frames";
 const QString ANTIALIAS_ENABLED        = "Antialias enabled";
 const QString ANTIALIAS_FRAMES         = "Antialias frames";
+const QString INTERACTIVE_ENABLED      = "Interactive rate enabled";
+const QString INTERACTIVE_RATE         = "Interactive rate";
+const QString DRAFT_VOLUMES            = "Draft volumes";
+const QString SCENE_VOLUMES            = "Scene volumes";
+const QString PREPROCESS_MCI           = "Preprocess MCI image";
+const QString PREPROCESS_SLAB          = "Preprocessing slab budget MB";
+const QString OUT_OF_CORE              = "Out-of-core volumes";
+const QString OUT_OF_CORE_BUDGET       = "Out-of-core budget MB";
+const QString FUSION_THRESHOLD         = "Fusion MCI threshold";
+const QString FUSION_INSIDE_ANATOMY    = "Fusion MCI only inside anatomy";
+const QString MAPPER_TUNED             = "Volume mapper tuned";
+const QString MAPPER_SAMPLE_DISTANCE   = "Volume mapper sample distance";
+const QString MAPPER_IMAGE_DISTANCE    = "Volume mapper image sample distance";
+const QString MAPPER_THREADS           = "Volume mapper threads";
+const QString MAPPER_TOLERANCE         = "Volume mapper PSNR tolerance";
+const QString TRANSLUCENCY_METHOD      = "Translucency method";
+const QString OPTIMIZE_MESHES          = "Optimize meshes";
+const QString ANTIALIAS_METHOD         = "Antialias method";
+const QString SUPERSAMPLING_FACTOR     = "Supersampling factor";
 const QString AXES_SHOWN               = "Axes shown";
 const QString OUTPUT_DIR               = "Output directory";
 const QString FFMPEG_BINARY            = "FFMPEG binary";
@@ -75,9 +112,23 @@ MovieRenderer::MovieRenderer()
 : m_frameNum{0}
 , m_loader{nullptr}
 , m_executor{nullptr}
+, m_waiting{false}
+, m_preprocessMCI{false}
+, m_slabBudget{64}
+, m_outOfCore{false}
+, m_brickBudget{4096}
+, m_stillTime{0}
+, m_translucency{Translucency::DEFAULT}
+, m_renderTime{0}
+, m_antialiasing{Antialiasing::MULTISAMPLE}
+, m_supersampling{2}
+, m_optimizeMeshes{false}
 {
   setupUi(this);
 
+  m_reloadTimer.setSingleShot(true);
+  m_reloadTimer.setInterval(500);
+
   connectSignals();
 
   setupVTKView();
@@ -161,11 +212,25 @@ void MovieRenderer::startRender()
 {
   statusBar()->showMessage(tr("Start rendering frames."));
 
-  m_frameNum = 0;
+  m_frameNum   = 0;
+  m_renderTime = 0;
 
   modifyUI(false);
 
   updateRendererSettings();
+  tuneVolumeMappers();
+
+  // the first frame has no previous frame to blur from.
+  m_timeline.clear();
+  if(m_executor)
+  {
+    for(auto actor: {m_executor->m_brainActor, m_executor->m_mciActor}) m_timeline.track(actor);
+    for(auto volume: m_executor->m_volumes) m_timeline.track(volume);
+  }
+
+  // frames are rendered with the still update rate so the meshes levels of detail are not used.
+  auto renderWindow = m_renderer->GetRenderWindow();
+  renderWindow->SetDesiredUpdateRate(renderWindow->GetInteractor()->GetStillUpdateRate());
 
   renderScript();
 }
@@ -181,22 +246,242 @@ void MovieRenderer::updateRendererSettings()
   renderWindow->SetLineSmoothing(m_lineSmoothing->isChecked());
   renderWindow->SetPolygonSmoothing(m_polygonSmoothing->isChecked());
 
-  if(m_motionBlur->isChecked())
+  // motion blur accumulates the timeline subframes when capturing, the window subframes would be identical.
+  renderWindow->SetSubFrames(0);
+
+  if(m_antiAlias->isChecked() && m_antialiasing == Antialiasing::MULTISAMPLE)
   {
-    renderWindow->SetSubFrames(m_motionBlurFrames->value());
+    renderWindow->SetMultiSamples(m_aliasFrames->value());
   }
   else
   {
-    renderWindow->SetSubFrames(0);
+    renderWindow->SetMultiSamples(0);
   }
 
-  if(m_antiAlias->isChecked())
+  applyMapperSettings(m_mapperSettings);
+
+  setVolumesLevel(m_draftVolumes->isChecked() ? 1 : 0);
+
+  auto interactor = renderWindow->GetInteractor();
+  if(interactor)
   {
-    renderWindow->SetMultiSamples(m_aliasFrames->value());
+    // without the interactive rate the interaction renders are allocated as much time as the still ones.
+    const auto rate = m_interactive->isChecked() ? m_interactiveRate->value() : interactor->GetStillUpdateRate();
+    interactor->SetDesiredUpdateRate(rate);
   }
-  else
+}
+
+//--------------------------------------------------------------------
+void MovieRenderer::applyInteractionSettings()
+{
+  if(!m_interactive->isChecked()) return;
+
+  auto renderWindow = m_renderer->GetRenderWindow();
+  renderWindow->SetPointSmoothing(false);
+  renderWindow->SetLineSmoothing(false);
+  renderWindow->SetPolygonSmoothing(false);
+  renderWindow->SetSubFrames(0);
+  renderWindow->SetMultiSamples(0);
+
+  // the ray cast mappers adjust the image sample distance to the time allocated by the interactor.
+  auto volumes = m_renderer->GetVolumes();
+  volumes->InitTraversal();
+  while(auto volume = volumes->GetNextVolume())
   {
-    renderWindow->SetMultiSamples(0);
+    auto mapper = vtkFixedPointVolumeRayCastMapper::SafeDownCast(volume->GetMapper());
+    if(mapper)
+    {
+      mapper->AutoAdjustSampleDistancesOn();
+      mapper->SetMaximumImageSampleDistance(4.0);
+    }
+  }
+
+  setVolumesLevel(m_draftVolumes->isChecked() ? 2 : 1);
+}
+
+//--------------------------------------------------------------------
+void MovieRenderer::setVolumesLevel(const int level)
+{
+  for(auto volume: m_volumeLevels.keys())
+  {
+    const auto &levels = m_volumeLevels[volume];
+    auto mapper = vtkAbstractVolumeMapper::SafeDownCast(volume->GetMapper());
+    if(!mapper || levels.isEmpty()) continue;
+
+    auto image = levels.at(std::min(level, levels.size() - 1));
+    if(mapper->GetDataSetInput() != image) mapper->SetInputDataObject(image);
+  }
+}
+
+//--------------------------------------------------------------------
+void MovieRenderer::applyMapperSettings(const MapperSettings &settings)
+{
+  auto volumes = m_renderer->GetVolumes();
+  volumes->InitTraversal();
+  while(auto volume = volumes->GetNextVolume())
+  {
+    auto mapper = vtkFixedPointVolumeRayCastMapper::SafeDownCast(volume->GetMapper());
+    if(mapper)
+    {
+      mapper->AutoAdjustSampleDistancesOff();
+      mapper->SetSampleDistance(settings.sampleDistance);
+      mapper->SetImageSampleDistance(settings.imageSampleDistance);
+      if(settings.threads > 0) mapper->SetNumberOfThreads(settings.threads);
+    }
+  }
+}
+
+//--------------------------------------------------------------------
+void MovieRenderer::tuneVolumeMappers()
+{
+  if(m_renderer->GetVolumes()->GetNumberOfItems() == 0) return;
+
+  auto name = QApplication::applicationDirPath() + "/VTKMovieRenderer.ini";
+  QSettings settings(name, QSettings::IniFormat);
+
+  // settings tuned for other resolutions, mappers or volumes aren't valid.
+  const auto group = mapperSettingsGroup();
+  settings.beginGroup(group);
+  const auto tuned = settings.value(MAPPER_TUNED, false).toBool();
+  if(tuned)
+  {
+    m_mapperSettings.sampleDistance      = settings.value(MAPPER_SAMPLE_DISTANCE, 1.0).toDouble();
+    m_mapperSettings.imageSampleDistance = settings.value(MAPPER_IMAGE_DISTANCE, 1.0).toDouble();
+    m_mapperSettings.threads             = std::max(0, settings.value(MAPPER_THREADS, 0).toInt());
+    m_mapperSettings.tuned               = true;
+  }
+  settings.endGroup();
+
+  if(tuned)
+  {
+    applyMapperSettings(m_mapperSettings);
+    return;
+  }
+
+  statusBar()->showMessage(tr("Tuning volume mappers..."));
+  QApplication::processEvents();
+
+  auto renderWindow = m_renderer->GetRenderWindow();
+
+  auto capture = [renderWindow]()
+  {
+    auto windowToImageFilter = vtkSmartPointer<vtkWindowToImageFilter>::New();
+    windowToImageFilter->SetInput(renderWindow);
+    windowToImageFilter->SetInputBufferTypeToRGB();
+    windowToImageFilter->ReadFrontBufferOff();
+    windowToImageFilter->Update();
+
+    return vtkSmartPointer<vtkImageData>{windowToImageFilter->GetOutput()};
+  };
+
+  // reference is sampled finer than any candidate.
+  MapperSettings reference;
+  reference.sampleDistance = 0.25;
+  applyMapperSettings(reference);
+  renderWindow->Render();
+  auto referenceImage = capture();
+
+  const auto tolerance = settings.value(MAPPER_TOLERANCE, 40.).toDouble();
+
+  const int cores = std::max(1u, std::thread::hardware_concurrency());
+
+  auto best     = m_mapperSettings;
+  auto bestTime = std::numeric_limits<double>::max();
+  for(auto sampleDistance: {0.5, 1.0, 2.0})
+  {
+    for(auto imageSampleDistance: {1.0, 1.5, 2.0})
+    {
+      for(auto threads: {cores, std::max(1, cores / 2)})
+      {
+        MapperSettings candidate;
+        candidate.sampleDistance      = sampleDistance;
+        candidate.imageSampleDistance = imageSampleDistance;
+        candidate.threads             = threads;
+        applyMapperSettings(candidate);
+
+        // first render updates the mapper state, the second one is timed.
+        renderWindow->Render();
+        const auto start = std::chrono::steady_clock::now();
+        renderWindow->Render();
+        const auto time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        const auto quality = peakSignalToNoise(referenceImage, capture());
+
+        qDebug() << "Mapper sample distance" << sampleDistance << "image sample distance" << imageSampleDistance
+                 << "threads" << threads << "-" << time << "ms" << quality << "dB";
+
+        if(quality >= tolerance && time < bestTime)
+        {
+          best     = candidate;
+          bestTime = time;
+        }
+      }
+    }
+  }
+
+  m_mapperSettings       = best;
+  m_mapperSettings.tuned = true;
+  applyMapperSettings(m_mapperSettings);
+
+  settings.beginGroup(group);
+  settings.setValue(MAPPER_TUNED, true);
+  settings.setValue(MAPPER_SAMPLE_DISTANCE, m_mapperSettings.sampleDistance);
+  settings.setValue(MAPPER_IMAGE_DISTANCE, m_mapperSettings.imageSampleDistance);
+  settings.setValue(MAPPER_THREADS, m_mapperSettings.threads);
+  settings.endGroup();
+  settings.sync();
+
+  statusBar()->showMessage(tr("Volume mappers tuned: sample distance %1, image sample distance %2, %3 threads.")
+                           .arg(m_mapperSettings.sampleDistance).arg(m_mapperSettings.imageSampleDistance)
+                           .arg(m_mapperSettings.threads));
+}
+
+//--------------------------------------------------------------------
+QString MovieRenderer::mapperSettingsGroup() const
+{
+  const auto size = m_renderer->GetRenderWindow()->GetSize();
+
+  QString mapper = "none";
+  auto volumes = m_renderer->GetVolumes();
+  volumes->InitTraversal();
+  auto volume = volumes->GetNextVolume();
+  if(volume && volume->GetMapper()) mapper = volume->GetMapper()->GetClassName();
+
+  auto names = m_sceneVolumes;
+  names.sort();
+
+  return QString("Volume mapper %1x%2 %3 %4%5").arg(size[0]).arg(size[1]).arg(mapper).arg(names.join(" "))
+                                                .arg(m_outOfCore ? " out-of-core" : "");
+}
+
+//--------------------------------------------------------------------
+void MovieRenderer::onInteractionEvent(vtkObject *caller, unsigned long eventId, void *clientData, void *callData)
+{
+  auto window = static_cast<MovieRenderer *>(clientData);
+  if(!window) return;
+
+  switch(eventId)
+  {
+    case vtkCommand::StartInteractionEvent:
+      window->m_stillTime = window->m_renderer->GetLastRenderTimeInSeconds() * 1000;
+      window->applyInteractionSettings();
+      break;
+    case vtkCommand::EndInteractionEvent:
+      {
+        const auto interactiveTime = window->m_renderer->GetLastRenderTimeInSeconds() * 1000;
+        if(window->m_interactive->isChecked() && interactiveTime > 0 && window->m_stillTime > 0)
+        {
+          const auto message = tr("Interactive frame %1 ms, full quality frame %2 ms (%3x faster).");
+          window->statusBar()->showMessage(message.arg(interactiveTime, 0, 'f', 1).arg(window->m_stillTime, 0, 'f', 1)
+                                                  .arg(window->m_stillTime / interactiveTime, 0, 'f', 1));
+        }
+
+        window->updateRendererSettings();
+        window->m_renderer->GetRenderWindow()->Render();
+      }
+      break;
+    default:
+      break;
   }
 }
 
@@ -207,6 +492,9 @@ void MovieRenderer::connectSignals()
   connect(m_render, SIGNAL(pressed()), this, SLOT(onRenderPressed()));
   connect(m_motionBlur, SIGNAL(stateChanged(int)), this, SLOT(onMotionBlurChanged(int)));
   connect(m_antiAlias, SIGNAL(stateChanged(int)), this, SLOT(onAntiAliasChanged(int)));
+  connect(m_interactive, SIGNAL(stateChanged(int)), this, SLOT(onInteractiveChanged(int)));
+  connect(m_interactiveRate, SIGNAL(valueChanged(int)), this, SLOT(updateRendererSettings()));
+  connect(m_draftVolumes, SIGNAL(stateChanged(int)), this, SLOT(updateRendererSettings()));
   connect(m_dirButton, SIGNAL(pressed()), this, SLOT(onDirButtonPressed()));
   connect(m_ffmpegDir, SIGNAL(pressed()), this, SLOT(onFFMPEGDirButtonPressed()));
   connect(m_resetCamera, SIGNAL(pressed()), this, SLOT(onCameraResetPressed()));
@@ -216,12 +504,46 @@ void MovieRenderer::connectSignals()
   connect(m_pointSmoothing, SIGNAL(stateChanged(int)), this, SLOT(updateRendererSettings()));
   connect(m_polygonSmoothing, SIGNAL(stateChanged(int)), this, SLOT(updateRendererSettings()));
   connect(m_saveCamera, SIGNAL(pressed()), this, SLOT(saveCameraPosition()));
+  connect(&m_watcher, SIGNAL(fileChanged(const QString &)), this, SLOT(onFileChanged(const QString &)));
+  connect(&m_reloadTimer, SIGNAL(timeout()), this, SLOT(onReloadChanged()));
 }
 
 //--------------------------------------------------------------------
 void MovieRenderer::onResourcesLoaded()
 {
-  auto loader = qobject_cast<ResourceLoaderThread *>(sender());
+  // emissions of a stopped loader can still be queued, they are ignored.
+  if(!m_loader || sender() != m_loader.get()) return;
+
+  resumeScript();
+
+  // keeps the loader alive until the end of the method.
+  auto current = m_loader;
+  auto loader  = qobject_cast<ResourceLoaderThread *>(sender());
+
+  if(loader && !loader->isAborted() && loader->isPartial())
+  {
+    m_reloadResources->setEnabled(true);
+
+    if(!loader->getError().isEmpty())
+    {
+      m_loader = nullptr;
+      errorDialog(tr("Error reloading resources"), loader->getError());
+      return;
+    }
+
+    if(!applyPartialReload(loader))
+    {
+      m_loader = nullptr;
+      onReloadPressed();
+      return;
+    }
+
+    m_loader = nullptr;
+    return;
+  }
+
+  // the executor is created when the resources of the first shot are loaded.
+  const auto started = (m_executor != nullptr);
 
   if(loader && !loader->isAborted())
   {
@@ -234,14 +556,24 @@ void MovieRenderer::onResourcesLoaded()
 
     statusBar()->showMessage("Resources loaded");
 
-    // prepare script to run
-    m_executor = std::make_shared<ScriptExecutor>(m_renderer, loader, this);
-    connect(m_executor.get(), SIGNAL(finished()), this, SLOT(onScriptFinished()));
-    connect(m_executor.get(), SIGNAL(render()), this, SLOT(onRenderSignaled()));
+    m_resources    = loader->resources();
+    m_dependencies = loader->dependencies();
+    m_volumeLevels = loader->volumeLevels();
+
+    if(!m_watcher.files().isEmpty()) m_watcher.removePaths(m_watcher.files());
+    if(!m_dependencies.isEmpty()) m_watcher.addPaths(m_dependencies.keys());
+
+    if(!started) createExecutor();
 
-    if(!m_executor->getError().isEmpty())
+    // the volumes are shown once all of them have been loaded and recentered.
+    // out-of-core volumes map the bricks in view before each render.
+    m_bricked = loader->brickedVolumes();
+    for(auto bricked: m_bricked) bricked->attach(m_renderer);
+
+    if(m_executor)
     {
-      errorDialog(tr("Error loading resources."), m_executor->getError());
+      m_executor->addVolumes(loader->volumes());
+      updateRendererSettings();
     }
   }
   else
@@ -256,7 +588,7 @@ void MovieRenderer::onResourcesLoaded()
     }
   }
 
-  onCameraResetPressed();
+  if(!started) onCameraResetPressed();
 
   m_render->setEnabled(true);
   m_resetCamera->setEnabled(true);
@@ -265,6 +597,249 @@ void MovieRenderer::onResourcesLoaded()
   m_loader = nullptr;
 }
 
+//--------------------------------------------------------------------
+void MovieRenderer::onResourceLoaded(const QString &name)
+{
+  if(!m_loader || sender() != m_loader.get()) return;
+
+  resumeScript();
+
+  // with volumes in the scene the script can't start before the loader has finished.
+  auto loader = qobject_cast<ResourceLoaderThread *>(sender());
+  if(!loader || loader->isPartial() || m_executor || !m_sceneVolumes.isEmpty()) return;
+
+  m_available << name;
+
+  for(auto resource: ScriptExecutor::shotResources().first())
+  {
+    if(!m_available.contains(resource)) return;
+  }
+
+  statusBar()->showMessage(tr("First shot resources loaded, loading the rest in the background."));
+
+  createExecutor();
+
+  onCameraResetPressed();
+
+  m_render->setEnabled(true);
+  m_resetCamera->setEnabled(true);
+}
+
+//--------------------------------------------------------------------
+void MovieRenderer::createExecutor()
+{
+  // prepare script to run, the resources are taken from the registry as the loader can be still running.
+  m_executor = std::make_shared<ScriptExecutor>(m_renderer);
+
+  if(!m_executor->getError().isEmpty())
+  {
+    errorDialog(tr("Error loading resources."), m_executor->getError());
+  }
+
+  applyTranslucency();
+}
+
+//--------------------------------------------------------------------
+void MovieRenderer::applyTranslucency()
+{
+  m_sorter.clear();
+
+  const auto peeling = (m_translucency == Translucency::DEPTH_PEELING);
+  m_renderer->SetUseDepthPeeling(peeling);
+  m_renderer->SetMaximumNumberOfPeels(8);
+  m_renderer->SetOcclusionRatio(0.);
+  m_renderer->GetRenderWindow()->SetAlphaBitPlanes(peeling);
+
+  if(m_translucency == Translucency::SORTED && m_executor)
+  {
+    for(auto actor: {m_executor->m_brainActor, m_executor->m_mciActor})
+    {
+      if(actor) m_sorter.add(m_renderer, actor);
+    }
+  }
+}
+
+//--------------------------------------------------------------------
+QList<vtkActor2D *> MovieRenderer::overlayActors() const
+{
+  QList<vtkActor2D *> actors;
+
+  auto collection = m_renderer->GetActors2D();
+  collection->InitTraversal();
+  while(auto actor = collection->GetNextActor2D())
+  {
+    if(actor->GetVisibility()) actors << actor;
+  }
+
+  return actors;
+}
+
+//--------------------------------------------------------------------
+QVector<unsigned long> MovieRenderer::overlayStamp() const
+{
+  unsigned long time = 0;
+
+  const auto actors = overlayActors();
+  for(auto actor: actors)
+  {
+    time = std::max(time, actor->GetMTime());
+    if(actor->GetMapper()) time = std::max(time, actor->GetMapper()->GetMTime());
+
+    // text and lookup table changes don't modify the actors.
+    auto text = vtkTextActor::SafeDownCast(actor);
+    if(text && text->GetTextProperty()) time = std::max(time, text->GetTextProperty()->GetMTime());
+
+    auto bar = vtkScalarBarActor::SafeDownCast(actor);
+    if(bar && bar->GetLookupTable()) time = std::max(time, bar->GetLookupTable()->GetMTime());
+  }
+
+  const auto size = m_renderer->GetRenderWindow()->GetSize();
+
+  return QVector<unsigned long>{time, static_cast<unsigned long>(actors.size()), static_cast<unsigned long>(size[0]), static_cast<unsigned long>(size[1])};
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkImageData> MovieRenderer::overlay(const int magnification)
+{
+  const auto stamp = overlayStamp();
+  if(stamp != m_overlayStamp)
+  {
+    m_overlays.clear();
+    m_overlayStamp = stamp;
+  }
+
+  if(m_overlays.contains(magnification)) return m_overlays[magnification];
+
+  auto renderWindow = m_renderer->GetRenderWindow();
+
+  // only the 2D actors over a plain background, other renderers (axes) are not drawn.
+  QList<vtkProp *> hidden;
+  auto props = m_renderer->GetViewProps();
+  props->InitTraversal();
+  while(auto prop = props->GetNextProp())
+  {
+    if(prop->GetVisibility() && !vtkActor2D::SafeDownCast(prop))
+    {
+      prop->VisibilityOff();
+      hidden << prop;
+    }
+  }
+
+  QList<vtkRenderer *> skipped;
+  auto renderers = renderWindow->GetRenderers();
+  renderers->InitTraversal();
+  while(auto renderer = renderers->GetNextItem())
+  {
+    if(renderer != m_renderer && renderer->GetDraw())
+    {
+      renderer->DrawOff();
+      skipped << renderer;
+    }
+  }
+
+  double background[3];
+  m_renderer->GetBackground(background);
+  const auto gradient = m_renderer->GetGradientBackground();
+  m_renderer->GradientBackgroundOff();
+
+  auto capture = [renderWindow, magnification]()
+  {
+    auto windowToImageFilter = vtkSmartPointer<vtkWindowToImageFilter>::New();
+    windowToImageFilter->SetInput(renderWindow);
+    windowToImageFilter->SetMagnification(magnification);
+    windowToImageFilter->SetFixBoundary(true);
+    windowToImageFilter->SetInputBufferTypeToRGB();
+    windowToImageFilter->ReadFrontBufferOff();
+    windowToImageFilter->Update();
+
+    return vtkSmartPointer<vtkImageData>{windowToImageFilter->GetOutput()};
+  };
+
+  m_renderer->SetBackground(0, 0, 0);
+  renderWindow->Render();
+  auto onBlack = capture();
+
+  m_renderer->SetBackground(1, 1, 1);
+  renderWindow->Render();
+  auto onWhite = capture();
+
+  m_renderer->SetBackground(background);
+  m_renderer->SetGradientBackground(gradient);
+  for(auto renderer: skipped) renderer->DrawOn();
+  for(auto prop: hidden) prop->VisibilityOn();
+
+  auto result = premultipliedOverlay(onBlack, onWhite);
+  m_overlays.insert(magnification, result);
+
+  return result;
+}
+
+//--------------------------------------------------------------------
+QMap<int, vtkSmartPointer<vtkImageData>> MovieRenderer::captureFrames(const QList<int> &magnifications)
+{
+  QMap<int, vtkSmartPointer<vtkImageData>> frames;
+  if(magnifications.isEmpty()) return frames;
+
+  const auto supersample = m_antiAlias->isChecked() && m_antialiasing != Antialiasing::MULTISAMPLE;
+  const auto largest     = *std::max_element(magnifications.constBegin(), magnifications.constEnd());
+  const auto captures    = supersample ? QList<int>{largest * m_supersampling} : magnifications;
+
+  // overlays first, rasterizing them renders the window.
+  QMap<int, vtkSmartPointer<vtkImageData>> layers;
+  for(auto magnification: magnifications) layers.insert(magnification, overlay(magnification));
+
+  const auto composite = std::none_of(layers.constBegin(), layers.constEnd(), [](const vtkSmartPointer<vtkImageData> &layer) { return layer == nullptr; });
+
+  const auto actors = overlayActors();
+  if(composite)
+  {
+    for(auto actor: actors) actor->VisibilityOff();
+  }
+
+  auto capture = [this](const int magnification)
+  {
+    auto windowToImageFilter = vtkSmartPointer<vtkWindowToImageFilter>::New();
+    windowToImageFilter->SetInput(m_renderer->GetRenderWindow());
+    windowToImageFilter->SetMagnification(magnification);
+    windowToImageFilter->SetFixBoundary(true);
+    windowToImageFilter->SetInputBufferTypeToRGBA();
+    windowToImageFilter->Update();
+
+    return vtkSmartPointer<vtkImageData>{windowToImageFilter->GetOutput()};
+  };
+
+  QMap<int, vtkSmartPointer<vtkImageData>> scenes;
+  for(auto magnification: captures) scenes.insert(magnification, capture(magnification));
+
+  if(composite)
+  {
+    for(auto actor: actors) actor->VisibilityOn();
+
+    // hiding and showing the actors modifies them, the stamp is taken again to keep the overlays.
+    m_overlayStamp = overlayStamp();
+  }
+
+  for(auto magnification: magnifications)
+  {
+    auto frame = supersample ? scenes.first() : scenes[magnification];
+    if(supersample)
+    {
+      frame = resolveSupersampled(frame, largest * m_supersampling / magnification, m_antialiasing == Antialiasing::SUPERSAMPLE_TENT);
+    }
+
+    if(composite && !compositeOverlay(frame, layers[magnification]))
+    {
+      // sizes don't match, capture again with the actors.
+      m_overlays.remove(magnification);
+      frame = capture(magnification);
+    }
+
+    frames.insert(magnification, frame);
+  }
+
+  return frames;
+}
+
 //--------------------------------------------------------------------
 void MovieRenderer::setupVTKView()
 {
@@ -282,6 +857,12 @@ void MovieRenderer::setupVTKView()
   renderWindow->AddRenderer(m_renderer);
   renderWindow->GetInteractor()->SetInteractorStyle(interactorstyle);
 
+  auto interactionCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+  interactionCallback->SetCallback(onInteractionEvent);
+  interactionCallback->SetClientData(this);
+  interactorstyle->AddObserver(vtkCommand::StartInteractionEvent, interactionCallback);
+  interactorstyle->AddObserver(vtkCommand::EndInteractionEvent, interactionCallback);
+
   // Color background
   QPalette pal = this->palette();
   pal.setColor(QPalette::Base, pal.color(QPalette::Window));
@@ -319,17 +900,31 @@ void MovieRenderer::onAntiAliasChanged(int int1)
 }
 
 //--------------------------------------------------------------------
-void MovieRenderer::renderScript()
+void MovieRenderer::onInteractiveChanged(int value)
 {
-  if(m_executor->isRunning())
-  {
-    m_executor->abort();
+  m_interactiveRate->setEnabled(m_interactive->isChecked());
 
-    QApplication::processEvents();
-  }
+  updateRendererSettings();
+}
 
+//--------------------------------------------------------------------
+void MovieRenderer::renderScript()
+{
   m_executor->restart();
-  m_executor->start();
+  m_waiting = false;
+
+  QTimer::singleShot(0, this, SLOT(renderNextFrame()));
+}
+
+//--------------------------------------------------------------------
+void MovieRenderer::resumeScript()
+{
+  if(!m_waiting) return;
+
+  // the resource the script waits for may not be this one, the script will wait again if so.
+  m_waiting = false;
+
+  QTimer::singleShot(0, this, SLOT(renderNextFrame()));
 }
 
 //--------------------------------------------------------------------
@@ -385,26 +980,67 @@ void MovieRenderer::errorDialog(const QString &title, const QString& message)
 }
 
 //--------------------------------------------------------------------
-void MovieRenderer::onRenderSignaled()
+void MovieRenderer::renderNextFrame()
 {
-  if(m_executor->isFinished()) return;
+  if(!m_executor || m_executor->isAborted()) return;
+
+  SceneDescriptor scene;
+  switch(m_executor->nextScene(scene))
+  {
+    case ScriptExecutor::Step::FINISHED:
+      onScriptFinished();
+      return;
+    case ScriptExecutor::Step::WAIT:
+      // waiting for a resource, resumed when the loader signals a loaded resource.
+      m_waiting = true;
+      return;
+    default:
+      break;
+  }
+
+  m_executor->apply(scene);
 
   m_view->update();
-  auto renderWindow = m_view->GetRenderWindow();
 
   auto outputDir = QDir::toNativeSeparators(m_directory->text() + "/");
 
-  if(m_renderFull->isChecked() || m_renderHalf->isChecked())
+  QList<int> magnifications;
+  if(m_renderFull->isChecked() || m_renderHalf->isChecked()) magnifications << 1;
+  if(m_render4K->isChecked()) magnifications << 3;
+
+  // Screenshots, timed with the magnified tiles and the motion blur subframes.
+  QElapsedTimer timer;
+  timer.start();
+
+  auto screenshots = captureFrames(magnifications);
+
+  m_timeline.advance();
+
+  const auto subframes = m_motionBlur->isChecked() ? m_motionBlurFrames->value() : 1;
+  if(subframes > 1 && !m_timeline.isStill())
   {
-    // Screenshot
-    auto windowToImageFilter = vtkSmartPointer<vtkWindowToImageFilter>::New();
-    windowToImageFilter->SetInput(renderWindow);
-    windowToImageFilter->SetMagnification(1);
-    windowToImageFilter->SetFixBoundary(true);
-    windowToImageFilter->SetInputBufferTypeToRGBA();
-    windowToImageFilter->Update();
+    // the shutter is open from the previous frame to this one, the last subframe is the frame itself.
+    QMap<int, std::vector<float>> sums;
+    for(auto magnification: magnifications) accumulateImage(sums[magnification], screenshots[magnification]);
+
+    for(int i = 1; i < subframes; ++i)
+    {
+      m_timeline.apply(static_cast<double>(i) / subframes);
+
+      const auto subframe = captureFrames(magnifications);
+      for(auto magnification: magnifications) accumulateImage(sums[magnification], subframe[magnification]);
+    }
+
+    m_timeline.restore();
+
+    for(auto magnification: magnifications) averageImage(sums[magnification], subframes, screenshots[magnification]);
+  }
 
-    auto screenshot = windowToImageFilter->GetOutput();
+  m_renderTime += timer.nsecsElapsed() / 1.e9;
+
+  if(m_renderFull->isChecked() || m_renderHalf->isChecked())
+  {
+    auto screenshot = screenshots[1];
 
     if(m_renderFull->isChecked()) // 1280x720
     {
@@ -440,19 +1076,13 @@ void MovieRenderer::onRenderSignaled()
 
   if(m_render4K->isChecked()) // 3840x2160
   {
-    // Screenshot
-    auto windowToImageFilter = vtkSmartPointer<vtkWindowToImageFilter>::New();
-    windowToImageFilter->SetInput(renderWindow);
-    windowToImageFilter->SetMagnification(3);
-    windowToImageFilter->SetFixBoundary(true);
-    windowToImageFilter->SetInputBufferTypeToRGBA();
-    windowToImageFilter->Update();
+    auto screenshot = screenshots[3];
 
     auto name = outputDir + QString("Frame_4K_%1.png").arg(QString::number(m_frameNum), 5, QChar('0'));
 
     auto writer = vtkSmartPointer<vtkPNGWriter>::New();
     writer->SetFileName(name.toStdString().c_str());
-    writer->SetInputData(windowToImageFilter->GetOutput());
+    writer->SetInputData(screenshot);
     writer->Write();
   }
 
@@ -460,9 +1090,7 @@ void MovieRenderer::onRenderSignaled()
 
   ++m_frameNum;
 
-  QApplication::processEvents();
-
-  m_executor->nextFrame();
+  QTimer::singleShot(0, this, SLOT(renderNextFrame()));
 }
 
 //--------------------------------------------------------------------
@@ -478,24 +1106,183 @@ void MovieRenderer::onReloadPressed()
 {
   statusBar()->showMessage("Cleaning view and launching resources loader");
 
+  m_reloadTimer.stop();
+  m_changedFiles.clear();
+
+  m_sorter.clear();
+  m_timeline.clear();
+  m_overlays.clear();
+  for(auto bricked: m_bricked) bricked->detach();
+  m_bricked.clear();
   m_renderer->RemoveAllViewProps();
+  m_volumeLevels.clear();
+  m_available.clear();
+  m_executor = nullptr;
 
   m_reloadResources->setEnabled(false);
   m_resetCamera->setEnabled(false);
 
+  stopLoader();
+
+  m_loader = std::make_shared<ResourceLoaderThread>(this);
+  m_loader->setFusionRule(m_fusionRule);
+  m_loader->setOptimizeMeshes(m_optimizeMeshes);
+  m_loader->setVolumes(m_sceneVolumes);
+  m_loader->setPreprocessMCI(m_preprocessMCI);
+  m_loader->setSlabBudget(m_slabBudget * 1024ULL * 1024ULL);
+  m_loader->setOutOfCore(m_outOfCore);
+  m_loader->setBrickBudget(m_brickBudget * 1024ULL * 1024ULL);
+
+  QStringList order;
+  for(auto shot: ScriptExecutor::shotResources()) order << shot;
+  m_loader->setLoadOrder(order);
+
+  connect(m_loader.get(), SIGNAL(finished()), this, SLOT(onResourcesLoaded()));
+  connect(m_loader.get(), SIGNAL(resourceLoaded(const QString &)), this, SLOT(onResourceLoaded(const QString &)));
+  connect(m_loader.get(), SIGNAL(progress(int)), this, SLOT(onLoadingProgress(int)));
+
+  m_loader->start();
+}
+
+//--------------------------------------------------------------------
+void MovieRenderer::stopLoader()
+{
   if(m_loader)
   {
-    disconnect(m_loader.get(), SIGNAL(finished()), this, SLOT(onResourcesLoaded()));
+    // all the loader signals, the slots also ignore the emissions already queued.
+    m_loader->disconnect(this);
+
+    if(m_loader->isRunning())
+    {
+      m_loader->abort();
+      m_loader->wait();
+    }
+
     m_loader = nullptr;
   }
+}
 
-  m_loader = std::make_shared<ResourceLoaderThread>(this);
+//--------------------------------------------------------------------
+void MovieRenderer::onLoadingProgress(int value)
+{
+  statusBar()->showMessage(tr("Loading resources: %1%").arg(value));
+}
+
+//--------------------------------------------------------------------
+void MovieRenderer::onFileChanged(const QString &path)
+{
+  m_changedFiles << path;
+
+  // some editors save by replacing the file and the watcher stops watching it.
+  if(!m_watcher.files().contains(path) && QFileInfo{path}.exists())
+  {
+    m_watcher.addPath(path);
+  }
+
+  m_reloadTimer.start();
+}
+
+//--------------------------------------------------------------------
+void MovieRenderer::onReloadChanged()
+{
+  if(m_changedFiles.isEmpty()) return;
+
+  if(m_loader || (m_executor && !m_executor->isFinished()))
+  {
+    // try again when the current load or render finishes.
+    m_reloadTimer.start();
+    return;
+  }
+
+  QStringList names;
+  for(auto file: m_changedFiles)
+  {
+    for(auto name: m_dependencies.value(file))
+    {
+      if(!names.contains(name)) names << name;
+    }
+  }
+  m_changedFiles.clear();
+
+  if(names.isEmpty()) return;
+
+  statusBar()->showMessage(tr("Reloading %1").arg(names.join(", ")));
+
+  m_reloadResources->setEnabled(false);
+
+  m_loader = std::make_shared<ResourceLoaderThread>(names, this);
+  m_loader->setFusionRule(m_fusionRule);
+  m_loader->setOptimizeMeshes(m_optimizeMeshes);
+  m_loader->setVolumes(m_sceneVolumes);
+  m_loader->setPreprocessMCI(m_preprocessMCI);
+  m_loader->setSlabBudget(m_slabBudget * 1024ULL * 1024ULL);
+  m_loader->setOutOfCore(m_outOfCore);
+  m_loader->setBrickBudget(m_brickBudget * 1024ULL * 1024ULL);
 
   connect(m_loader.get(), SIGNAL(finished()), this, SLOT(onResourcesLoaded()));
+  connect(m_loader.get(), SIGNAL(progress(int)), this, SLOT(onLoadingProgress(int)));
 
   m_loader->start();
 }
 
+//--------------------------------------------------------------------
+bool MovieRenderer::applyPartialReload(ResourceLoaderThread *loader)
+{
+  // out-of-core volumes are new bricked files, they can't be updated in place.
+  if(!loader->brickedVolumes().isEmpty()) return false;
+
+  auto resources = loader->resources();
+
+  for(auto name: resources.keys())
+  {
+    auto current = m_resources.value(name);
+    auto updated = resources.value(name);
+    if(!current || !updated) continue;
+
+    auto currentImage = vtkImageData::SafeDownCast(current);
+    auto updatedImage = vtkImageData::SafeDownCast(updated);
+    if(currentImage && updatedImage && currentImage->GetDataDimension() == 2)
+    {
+      // logo positions depend on the size of the others, computed when loaded.
+      int currentDims[3], updatedDims[3];
+      currentImage->GetDimensions(currentDims);
+      updatedImage->GetDimensions(updatedDims);
+
+      if(currentDims[0] != updatedDims[0] || currentDims[1] != updatedDims[1]) return false;
+    }
+  }
+
+  for(auto name: resources.keys())
+  {
+    auto current = m_resources.value(name);
+    if(!current) continue;
+
+    current->ShallowCopy(resources.value(name));
+    current->Modified();
+
+    // the live object keeps the name, the loaded one is released with the loader.
+    ResourceRegistry::instance().setName(name, current);
+  }
+
+  auto dependencies = loader->dependencies();
+  for(auto file: dependencies.keys())
+  {
+    for(auto name: dependencies.value(file))
+    {
+      if(!m_dependencies[file].contains(name)) m_dependencies[file] << name;
+    }
+
+    if(!m_watcher.files().contains(file)) m_watcher.addPath(file);
+  }
+
+  m_renderer->GetRenderWindow()->Render();
+  m_view->update();
+
+  statusBar()->showMessage(tr("Reloaded %1").arg(resources.keys().join(", ")));
+
+  return true;
+}
+
 //--------------------------------------------------------------------
 void MovieRenderer::onCameraResetPressed()
 {
@@ -527,7 +1314,14 @@ void MovieRenderer::onCameraResetPressed()
 //--------------------------------------------------------------------
 void MovieRenderer::onScriptFinished()
 {
-  m_executor->restart();
+  if(m_frameNum > 0)
+  {
+    const QStringList methods{"default", "depth peeling", "sorted"};
+    qDebug() << "Translucency" << methods.at(static_cast<int>(m_translucency)) << "- meshes"
+             << (m_optimizeMeshes ? "optimized" : "as read") << "-" << m_frameNum << "frames,"
+             << 1000. * m_renderTime / m_frameNum << "ms per frame," << m_sorter.sorts() << "sorts";
+  }
+
   makeMovie();
 
   modifyUI(true);
@@ -655,6 +1449,20 @@ void MovieRenderer::saveSettings() const
   settings.setValue(MOTION_BLUR_FRAMES, m_motionBlurFrames->value());
   settings.setValue(ANTIALIAS_ENABLED, m_antiAlias->isChecked());
   settings.setValue(ANTIALIAS_FRAMES, m_aliasFrames->value());
+  settings.setValue(INTERACTIVE_ENABLED, m_interactive->isChecked());
+  settings.setValue(INTERACTIVE_RATE, m_interactiveRate->value());
+  settings.setValue(DRAFT_VOLUMES, m_draftVolumes->isChecked());
+  settings.setValue(SCENE_VOLUMES, m_sceneVolumes);
+  settings.setValue(PREPROCESS_MCI, m_preprocessMCI);
+  settings.setValue(PREPROCESS_SLAB, m_slabBudget);
+  settings.setValue(OUT_OF_CORE, m_outOfCore);
+  settings.setValue(OUT_OF_CORE_BUDGET, m_brickBudget);
+  settings.setValue(FUSION_THRESHOLD, m_fusionRule.threshold);
+  settings.setValue(FUSION_INSIDE_ANATOMY, m_fusionRule.insideAnatomy);
+  settings.setValue(TRANSLUCENCY_METHOD, static_cast<int>(m_translucency));
+  settings.setValue(OPTIMIZE_MESHES, m_optimizeMeshes);
+  settings.setValue(ANTIALIAS_METHOD, static_cast<int>(m_antialiasing));
+  settings.setValue(SUPERSAMPLING_FACTOR, m_supersampling);
   settings.setValue(AXES_SHOWN, m_axes->isChecked());
   settings.setValue(OUTPUT_DIR, m_directory->text());
   settings.setValue(FFMPEG_BINARY, m_ffmpegExe->text());
@@ -678,6 +1486,20 @@ void MovieRenderer::restoreSettings()
   m_motionBlurFrames->setValue(settings.value(MOTION_BLUR_FRAMES, 1).toInt());
   m_antiAlias->setChecked(settings.value(ANTIALIAS_ENABLED, true).toBool());
   m_aliasFrames->setValue(settings.value(ANTIALIAS_FRAMES, 5).toInt());
+  m_interactive->setChecked(settings.value(INTERACTIVE_ENABLED, true).toBool());
+  m_interactiveRate->setValue(settings.value(INTERACTIVE_RATE, 15).toInt());
+  m_draftVolumes->setChecked(settings.value(DRAFT_VOLUMES, false).toBool());
+  m_sceneVolumes             = settings.value(SCENE_VOLUMES, QStringList()).toStringList();
+  m_preprocessMCI            = settings.value(PREPROCESS_MCI, false).toBool();
+  m_slabBudget               = std::max(1, settings.value(PREPROCESS_SLAB, 64).toInt());
+  m_outOfCore                = settings.value(OUT_OF_CORE, false).toBool();
+  m_brickBudget              = std::max(1, settings.value(OUT_OF_CORE_BUDGET, 4096).toInt());
+  m_fusionRule.threshold     = std::min(255, std::max(0, settings.value(FUSION_THRESHOLD, 1).toInt()));
+  m_fusionRule.insideAnatomy = settings.value(FUSION_INSIDE_ANATOMY, false).toBool();
+  m_translucency             = static_cast<Translucency>(std::min(2, std::max(0, settings.value(TRANSLUCENCY_METHOD, 0).toInt())));
+  m_optimizeMeshes           = settings.value(OPTIMIZE_MESHES, false).toBool();
+  m_antialiasing             = static_cast<Antialiasing>(std::min(2, std::max(0, settings.value(ANTIALIAS_METHOD, 0).toInt())));
+  m_supersampling            = std::min(4, std::max(2, settings.value(SUPERSAMPLING_FACTOR, 2).toInt()));
   m_axes->setChecked(settings.value(AXES_SHOWN, false).toBool());
   m_directory->setText(settings.value(OUTPUT_DIR, QCoreApplication::applicationDirPath()).toString());
   m_ffmpegExe->setText(settings.value(FFMPEG_BINARY, QString()).toString());
@@ -688,17 +1510,11 @@ void MovieRenderer::closeEvent(QCloseEvent* event)
 {
   saveSettings();
 
-  if(m_loader && m_loader->isRunning())
-  {
-    m_loader->abort();
-    m_loader->thread()->wait(10000);
-    m_loader = nullptr;
-  }
+  stopLoader();
 
-  if(m_executor && m_executor->isRunning())
+  if(m_executor)
   {
     m_executor->abort();
-    m_executor->thread()->wait(10000);
     m_executor = nullptr;
   }
 }
@@ -23,11 +23,18 @@
 // Project
 #include "ScriptExecutor.h"
 #include "ResourceLoader.h"
+#include "TranslucencySorter.h"
+#include "Timeline.h"
 
 // Qt
 #include "ui_MovieRenderer.h"
 #include <QMainWindow>
 #include <QProcess>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QMap>
+#include <QSet>
+#include <QVector>
 
 // VTK
 #include <vtkSmartPointer.h>
@@ -42,6 +49,42 @@ class QObject;
 class QEvent;
 
 class vtkOrientationMarkerWidget;
+class vtkDataObject;
+class vtkObject;
+class vtkVolume;
+class vtkImageData;
+class vtkActor2D;
+
+/** \brief Settings of the ray cast volume mappers used for the final frames.
+ *
+ */
+struct MapperSettings
+{
+  double sampleDistance      = 1.0;   /** distance between samples along the rays, in world units. */
+  double imageSampleDistance = 1.0;   /** distance between rays, in pixels.                         */
+  int    threads             = 0;     /** number of threads, 0 for the mapper default.              */
+  bool   tuned               = false; /** true if chosen by the probe frame tuning.                 */
+};
+
+/** \brief Method used to render the translucent meshes.
+ *
+ */
+enum class Translucency: char
+{
+  DEFAULT       = 0, /** polygons in the order of the mapper.                 */
+  DEPTH_PEELING = 1, /** VTK depth peeling.                                   */
+  SORTED        = 2, /** polygons sorted back to front, cached per direction. */
+};
+
+/** \brief Method used to anti-alias the frames when anti-aliasing is enabled.
+ *
+ */
+enum class Antialiasing: char
+{
+  MULTISAMPLE      = 0, /** render window multisampling.                           */
+  SUPERSAMPLE_BOX  = 1, /** rendered at a multiple of the resolution, box filter.  */
+  SUPERSAMPLE_TENT = 2, /** rendered at a multiple of the resolution, tent filter. */
+};
 
 /** \class MovieRenderer
  * \brief Main application dialog.
@@ -86,6 +129,12 @@ class MovieRenderer
      */
     void onAntiAliasChanged(int value);
 
+    /** \brief Modifies the UI, enables/disables the interactive frame rate field.
+     * \param[in] value true to enable the frame rate field and false to disable it.
+     *
+     */
+    void onInteractiveChanged(int value);
+
     /** \brief Asks the user for an output directory for the frames and the video.
      *
      */
@@ -96,21 +145,46 @@ class MovieRenderer
      */
     void onFFMPEGDirButtonPressed();
 
-    /** \brief Creates the script executor once the resources have been loaded.
+    /** \brief Finishes the resources loading, creates the script executor if not created yet.
      *
      */
     void onResourcesLoaded();
 
-    /** \brief Saves current frame to disk.
+    /** \brief Creates the script executor once the resources of the first shot have been loaded, the rest are
+     * loaded in the background.
+     * \param[in] name loaded resource name.
+     *
+     */
+    void onResourceLoaded(const QString &name);
+
+    /** \brief Shows the resource loading progress in the status bar.
+     * \param[in] value progress value in [0,100].
+     *
+     */
+    void onLoadingProgress(int value);
+
+    /** \brief Advances the script one frame, applies its scene state, saves the frame to disk and schedules the
+     * next one. Finishes the render when the script has finished.
      *
      */
-    void onRenderSignaled();
+    void renderNextFrame();
 
     /** \brief Reloads the resources (to allow resource modification on disk on the fly).
      *
      */
     void onReloadPressed();
 
+    /** \brief Registers the changed file and schedules the reload of the resources that depend on it.
+     * \param[in] path changed file path.
+     *
+     */
+    void onFileChanged(const QString &path);
+
+    /** \brief Reloads only the resources whose files have changed on disk.
+     *
+     */
+    void onReloadChanged();
+
     /** \brief Resets the camera position to view all the resources in the renderer.
      *
      */
@@ -139,7 +213,8 @@ class MovieRenderer
      */
     void onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus);
 
-    /** \brief Updates the vtk render window settings with the settings of the UI.
+    /** \brief Updates the vtk render window settings with the settings of the UI. Restores the full quality
+     * after an interaction.
      *
      */
     void updateRendererSettings();
@@ -150,6 +225,85 @@ class MovieRenderer
     void saveCameraPosition() const;
 
   private:
+    /** \brief Creates the script executor with the registered resources.
+     *
+     */
+    void createExecutor();
+
+    /** \brief Lowers the quality of the render window settings to reach the interactive frame rate while
+     * moving the camera.
+     *
+     */
+    void applyInteractionSettings();
+
+    /** \brief Sets the input of the volumes mappers to the given resolution level, or the coarsest if the
+     * volume doesn't have that many.
+     * \param[in] level resolution level, 0 is full resolution.
+     *
+     */
+    void setVolumesLevel(const int level);
+
+    /** \brief Applies the given settings to the ray cast mappers of the volumes in the renderer.
+     * \param[in] settings mapper settings.
+     *
+     */
+    void applyMapperSettings(const MapperSettings &settings);
+
+    /** \brief Renders the current view as probe frame with each candidate mapper configuration and keeps the
+     * fastest one whose image is within the quality tolerance of a finely sampled reference. The result is
+     * stored in the ini file for the current resolution, mapper and volumes and reused if already tuned for
+     * them. Does nothing if there are no volumes in the renderer.
+     *
+     */
+    void tuneVolumeMappers();
+
+    /** \brief Returns the ini file group of the tuned mapper settings of the current resolution, mapper and
+     * volumes.
+     *
+     */
+    QString mapperSettingsGroup() const;
+
+    /** \brief Applies the translucency method to the renderer and the translucent actors of the script.
+     *
+     */
+    void applyTranslucency();
+
+    /** \brief Returns the visible 2D actors of the renderer, that are composited as a static overlay.
+     *
+     */
+    QList<vtkActor2D *> overlayActors() const;
+
+    /** \brief Returns the stamp of the current overlay, changes when any of the overlay actors is modified,
+     *         shown or hidden, or when the window is resized.
+     *
+     */
+    QVector<unsigned long> overlayStamp() const;
+
+    /** \brief Returns the premultiplied RGBA overlay for the given magnification, rasterized only if not
+     *         already cached.
+     * \param[in] magnification capture magnification.
+     *
+     */
+    vtkSmartPointer<vtkImageData> overlay(const int magnification);
+
+    /** \brief Captures the current frame at the given magnifications without rendering the 2D actors and
+     *         composites the cached overlays on them. When supersampling all the frames are resolved from a single
+     *         capture at the supersampling factor of the largest magnification.
+     * \param[in] magnifications capture magnifications.
+     *
+     */
+    QMap<int, vtkSmartPointer<vtkImageData>> captureFrames(const QList<int> &magnifications);
+
+    /** \brief VTK interactor style start/end interaction callback.
+     *
+     */
+    static void onInteractionEvent(vtkObject *caller, unsigned long eventId, void *clientData, void *callData);
+
+    /** \brief Aborts the current resource loader, if any, and waits for it to finish.
+     *
+     */
+    void stopLoader();
+
     /** \brief Runs the script executor and disables part of the UI.
      *
      */
@@ -171,11 +325,16 @@ class MovieRenderer
      */
     void modifyUI(bool);
 
-    /** \brief Helper method to start the script thread.
+    /** \brief Helper method to start running the script, one frame per event loop iteration.
      *
      */
     void renderScript();
 
+    /** \brief Schedules the next frame of the script if it was waiting for a resource to be loaded.
+     *
+     */
+    void resumeScript();
+
     /** \brief Initializes the vtk render window.
      *
      */
@@ -193,6 +352,13 @@ class MovieRenderer
      */
     void errorDialog(const QString &title, const QString& message);
 
+    /** \brief Swaps the data of the live resources with the ones of the given partial loader, in place, so the
+     * actors, mappers and textures using them are kept. Returns false if a full reload is needed instead.
+     * \param[in] loader finished partial resource loader.
+     *
+     */
+    bool applyPartialReload(ResourceLoaderThread *loader);
+
     /** \brief Saves the current settings to a ini file in the same directory as the executable.
      *
      */
@@ -208,9 +374,48 @@ class MovieRenderer
     vtkSmartPointer<vtkOrientationMarkerWidget> m_axesWidget; /** orientation marker widget. */
     std::atomic<unsigned long>                  m_frameNum;   /** current frame number.      */
 
-    // threads
-    std::shared_ptr<ResourceLoaderThread>       m_loader;     /** resource loader thread.    */
-    std::shared_ptr<ScriptExecutor>             m_executor;   /** script executor thread.    */
+    // loader and script
+    std::shared_ptr<ResourceLoaderThread>       m_loader;        /** resource loader thread.                          */
+    std::shared_ptr<ScriptExecutor>             m_executor;      /** script executor.                                 */
+    bool                                        m_waiting;       /** true if the script waits.                        */
+    QStringList                                 m_sceneVolumes;  /** volumes shown, ini file only.                    */
+    bool                                        m_preprocessMCI; /** true to preprocess the MCI image, ini file only. */
+    int                                         m_slabBudget;    /** preprocessing slab budget in MB, ini file only.  */
+    bool                                        m_outOfCore;     /** true to render out-of-core, ini file only.       */
+    int                                         m_brickBudget;   /** out-of-core budget in MB, ini file only.         */
+    QList<std::shared_ptr<BrickedVolume>>       m_bricked;       /** out-of-core volumes in the scene.                */
+
+    // hot reload
+    QFileSystemWatcher                            m_watcher;      /** watcher of the resource files.      */
+    QTimer                                        m_reloadTimer;  /** coalesces file changes.             */
+    QSet<QString>                                 m_changedFiles; /** changed files pending reload.       */
+    QMap<QString, QStringList>                    m_dependencies; /** file to resource names.             */
+    QMap<QString, vtkSmartPointer<vtkDataObject>> m_resources;    /** live data objects by resource name. */
+    QSet<QString>                                 m_available;    /** names of the loaded resources.      */
+    FusionRule                                    m_fusionRule;   /** fusion volume rule, ini file only.  */
+
+    // interaction
+    QMap<vtkSmartPointer<vtkVolume>, QList<vtkSmartPointer<vtkImageData>>> m_volumeLevels;   /** volume resolution levels.      */
+    double                                                                 m_stillTime;      /** last still render time in ms. */
+    MapperSettings                                                         m_mapperSettings; /** volume mappers settings.      */
+
+    // translucency
+    Translucency       m_translucency; /** translucent meshes rendering method, ini file only. */
+    TranslucencySorter m_sorter;       /** sorter of the translucent meshes polygons.          */
+    double             m_renderTime;   /** accumulated frame capture time in seconds.          */
+
+    // anti-aliasing
+    Antialiasing m_antialiasing;  /** anti-aliasing method, ini file only.                   */
+    int          m_supersampling; /** supersampling factor in each dimension, ini file only. */
+
+    // motion blur
+    Timeline m_timeline; /** state of the animated actors in the last frames. */
+
+    // overlay
+    QMap<int, vtkSmartPointer<vtkImageData>> m_overlays;     /** premultiplied RGBA overlays by magnification. */
+    QVector<unsigned long>                   m_overlayStamp; /** stamp of the cached overlays.                 */
+
+    bool               m_optimizeMeshes; /** true to optimize the meshes when loaded, ini file only. */
 };
 
 #endif
@@ -0,0 +1,460 @@
+/*
+ File: ResourceCache.cpp
+ Created on: 18/10/2026
+ Author: agent
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Project
+#include "ResourceCache.h"
+#include "BrickedVolume.h"
+#include "Utils.h"
+
+// VTK
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+
+// Qt
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDebug>
+
+// C++
+#include <cstring>
+
+const unsigned int ResourceCache::VERSION = 2;
+
+namespace
+{
+  const char MAGIC[8] = {'V','T','K','M','R','C','H','\0'};
+
+  enum class Kind: quint32 { MESH = 0, IMAGE = 1, BRICKED = 2 };
+
+  /** \brief Cell array block of a cached mesh.
+   *
+   */
+  struct CellsBlock
+  {
+    qint64 count;  /** number of cells.                       */
+    qint64 size;   /** number of values of the connectivity.  */
+    qint64 offset; /** offset of the connectivity in the file. */
+  };
+
+  /** \brief Cache entry header, followed by the data blocks aligned to 16 bytes.
+   *
+   */
+  struct Header
+  {
+    char       magic[8];       /** file identifier.                               */
+    quint32    version;        /** cache version.                                 */
+    quint32    kind;           /** kind of entry.                                 */
+    qint64     sourceSize;     /** size of the source file.                       */
+    qint64     sourceModified; /** source file modification time in msecs.        */
+    char       sourceHash[20]; /** SHA-1 of the source file contents.             */
+    quint32    idTypeSize;     /** size of vtkIdType when stored.                 */
+    qint64     dimensions[3];  /** image dimensions.                              */
+    double     spacing[3];     /** image spacing.                                 */
+    double     origin[3];      /** image origin.                                  */
+    qint32     scalarType;     /** image scalar type.                             */
+    qint32     components;     /** image scalar components.                       */
+    qint64     scalarsOffset;  /** offset of the image scalars in the file.       */
+    qint64     points;         /** mesh number of points.                         */
+    qint64     pointsOffset;   /** offset of the float points in the file.        */
+    qint64     normalsOffset;  /** offset of the float normals or 0 if none.      */
+    CellsBlock cells[4];       /** verts, lines, polys and strips cell arrays.    */
+  };
+
+  /** \brief Returns the given offset aligned to 16 bytes.
+   * \param[in] offset file offset.
+   *
+   */
+  inline qint64 aligned(const qint64 offset)
+  { return (offset + 15) & ~static_cast<qint64>(15); }
+
+  /** \brief Returns the SHA-1 hash of the contents of the given file or an empty array on error or if aborted.
+   * The file is read in chunks so the operation can be aborted.
+   * \param[in] filename file name.
+   * \param[in] abort abort flag or nullptr.
+   *
+   */
+  QByteArray fileHash(const QString &filename, const std::atomic<bool> *abort)
+  {
+    QFile file{filename};
+    if(!file.open(QIODevice::ReadOnly)) return QByteArray();
+
+    QCryptographicHash hash{QCryptographicHash::Sha1};
+    QByteArray buffer(4*1024*1024, '\0');
+    while(!file.atEnd())
+    {
+      if(abort && *abort) return QByteArray();
+
+      auto read = file.read(buffer.data(), buffer.size());
+      if(read < 0) return QByteArray();
+
+      hash.addData(buffer.constData(), read);
+    }
+
+    return hash.result();
+  }
+
+  /** \brief Initializes the header with the information of the source file, if any. Returns false on error.
+   * \param[out] header entry header.
+   * \param[in] source source file name.
+   * \param[in] kind kind of entry.
+   * \param[in] abort abort flag or nullptr.
+   *
+   */
+  bool initHeader(Header &header, const QString &source, const Kind kind, const std::atomic<bool> *abort)
+  {
+    std::memset(&header, 0, sizeof(Header));
+
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version    = ResourceCache::VERSION;
+    header.kind       = static_cast<quint32>(kind);
+    header.idTypeSize = sizeof(vtkIdType);
+
+    if(source.isEmpty()) return true;
+
+    QFileInfo info{source};
+    auto hash = fileHash(source, abort);
+    if(!info.exists() || hash.size() != sizeof(header.sourceHash)) return false;
+
+    std::memcpy(header.sourceHash, hash.constData(), sizeof(header.sourceHash));
+    header.sourceSize     = info.size();
+    header.sourceModified = info.lastModified().toMSecsSinceEpoch();
+
+    return true;
+  }
+
+  /** \brief Reads the header of the given entry and checks it against the source file. If only the modification
+   *         time differs the source contents hash is checked and, if equal, the entry is updated. Returns true if
+   *         the entry is valid and false otherwise.
+   * \param[in] entry entry file name.
+   * \param[in] source source file name.
+   * \param[in] kind expected kind of entry.
+   * \param[out] header entry header.
+   * \param[in] abort abort flag or nullptr.
+   *
+   */
+  bool readHeader(const QString &entry, const QString &source, const Kind kind, Header &header, const std::atomic<bool> *abort)
+  {
+    QFile file{entry};
+    if(!file.open(QIODevice::ReadOnly)) return false;
+
+    if(file.read(reinterpret_cast<char *>(&header), sizeof(Header)) != sizeof(Header)) return false;
+    file.close();
+
+    if(std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != ResourceCache::VERSION ||
+       header.kind != static_cast<quint32>(kind) || header.idTypeSize != sizeof(vtkIdType)) return false;
+
+    // entries without source are identified by their variant.
+    if(source.isEmpty()) return true;
+
+    QFileInfo info{source};
+    if(!info.exists() || info.size() != header.sourceSize) return false;
+
+    const auto modified = info.lastModified().toMSecsSinceEpoch();
+    if(modified != header.sourceModified)
+    {
+      // touched but maybe not modified, check contents.
+      auto hash = fileHash(source, abort);
+      if(hash.isEmpty() || hash != QByteArray(header.sourceHash, sizeof(header.sourceHash))) return false;
+
+      header.sourceModified = modified;
+      if(file.open(QIODevice::ReadWrite))
+      {
+        file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+        file.close();
+      }
+    }
+
+    return true;
+  }
+
+  /** \brief Pads the file up to the given offset and writes the given data. Returns true on success.
+   * \param[in] file output file.
+   * \param[in] offset file offset of the data.
+   * \param[in] data data pointer.
+   * \param[in] size size of data in bytes.
+   *
+   */
+  bool writeBlock(QSaveFile &file, const qint64 offset, const void *data, const qint64 size)
+  {
+    if(file.pos() > offset) return false;
+    if(file.pos() < offset)
+    {
+      QByteArray padding(offset - file.pos(), '\0');
+      if(file.write(padding) != padding.size()) return false;
+    }
+
+    return file.write(static_cast<const char *>(data), size) == size;
+  }
+}
+
+//--------------------------------------------------------------------
+ResourceCache::ResourceCache(const QString &directory)
+: m_directory{directory}
+, m_abort    {nullptr}
+{
+  if(m_directory.isEmpty())
+  {
+    m_directory = QCoreApplication::applicationDirPath() + "/cache/";
+  }
+
+  QDir().mkpath(m_directory);
+}
+
+//--------------------------------------------------------------------
+QString ResourceCache::entryName(const QString &source, const QString &variant) const
+{
+  auto key  = QFileInfo{source}.canonicalFilePath() + "|" + variant;
+  auto name = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex();
+
+  return QDir{m_directory}.absoluteFilePath(QString::fromLatin1(name) + ".cache");
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> ResourceCache::mesh(const QString &source, const QString &variant) const
+{
+  auto entry = entryName(source, variant);
+
+  Header header;
+  if(!readHeader(entry, source, Kind::MESH, header, m_abort)) return nullptr;
+
+  auto pointsData = mapArray(entry, header.pointsOffset, VTK_FLOAT, 3, header.points);
+  if(!pointsData) return nullptr;
+
+  auto points = vtkSmartPointer<vtkPoints>::New();
+  points->SetData(pointsData);
+
+  auto mesh = vtkSmartPointer<vtkPolyData>::New();
+  mesh->SetPoints(points);
+
+  if(header.normalsOffset != 0)
+  {
+    auto normals = mapArray(entry, header.normalsOffset, VTK_FLOAT, 3, header.points);
+    if(!normals) return nullptr;
+
+    normals->SetName("Normals");
+    mesh->GetPointData()->SetNormals(normals);
+  }
+
+  for(int i: {0,1,2,3})
+  {
+    const auto &block = header.cells[i];
+    if(block.count == 0) continue;
+
+    auto ids = vtkIdTypeArray::SafeDownCast(mapArray(entry, block.offset, VTK_ID_TYPE, 1, block.size));
+    if(!ids) return nullptr;
+
+    auto cells = vtkSmartPointer<vtkCellArray>::New();
+    cells->SetCells(block.count, ids);
+
+    switch(i)
+    {
+      case 0: mesh->SetVerts(cells); break;
+      case 1: mesh->SetLines(cells); break;
+      case 2: mesh->SetPolys(cells); break;
+      default:
+      case 3: mesh->SetStrips(cells); break;
+    }
+  }
+
+  return mesh;
+}
+
+//--------------------------------------------------------------------
+bool ResourceCache::storeMesh(const QString &source, const QString &variant, vtkPolyData *mesh) const
+{
+  if(!mesh || !mesh->GetPoints()) return false;
+
+  Header header;
+  if(!initHeader(header, source, Kind::MESH, m_abort)) return false;
+
+  auto points = vtkSmartPointer<vtkFloatArray>::New();
+  points->DeepCopy(mesh->GetPoints()->GetData());
+
+  vtkSmartPointer<vtkFloatArray> normals = nullptr;
+  if(mesh->GetPointData()->GetNormals())
+  {
+    normals = vtkSmartPointer<vtkFloatArray>::New();
+    normals->DeepCopy(mesh->GetPointData()->GetNormals());
+  }
+
+  vtkCellArray *cells[4]{mesh->GetVerts(), mesh->GetLines(), mesh->GetPolys(), mesh->GetStrips()};
+
+  const qint64 pointsSize = points->GetNumberOfTuples() * 3 * sizeof(float);
+  header.points       = points->GetNumberOfTuples();
+  header.pointsOffset = aligned(sizeof(Header));
+  auto offset         = aligned(header.pointsOffset + pointsSize);
+
+  if(normals)
+  {
+    header.normalsOffset = offset;
+    offset = aligned(offset + pointsSize);
+  }
+
+  for(int i: {0,1,2,3})
+  {
+    if(!cells[i] || cells[i]->GetNumberOfCells() == 0) continue;
+
+    header.cells[i].count  = cells[i]->GetNumberOfCells();
+    header.cells[i].size   = cells[i]->GetData()->GetNumberOfValues();
+    header.cells[i].offset = offset;
+    offset = aligned(offset + header.cells[i].size * sizeof(vtkIdType));
+  }
+
+  QSaveFile file{entryName(source, variant)};
+  if(!file.open(QIODevice::WriteOnly)) return false;
+
+  auto result = writeBlock(file, 0, &header, sizeof(Header));
+  result &= writeBlock(file, header.pointsOffset, points->GetVoidPointer(0), pointsSize);
+  if(normals) result &= writeBlock(file, header.normalsOffset, normals->GetVoidPointer(0), pointsSize);
+
+  for(int i: {0,1,2,3})
+  {
+    if(header.cells[i].count == 0) continue;
+
+    result &= writeBlock(file, header.cells[i].offset, cells[i]->GetData()->GetVoidPointer(0), header.cells[i].size * sizeof(vtkIdType));
+  }
+
+  if(!result)
+  {
+    qDebug() << "ResourceCache - can't write mesh entry of" << source;
+    file.cancelWriting();
+  }
+
+  return file.commit() && result;
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkImageData> ResourceCache::image(const QString &source, const QString &variant) const
+{
+  auto entry = entryName(source, variant);
+
+  Header header;
+  if(!readHeader(entry, source, Kind::IMAGE, header, m_abort)) return nullptr;
+
+  const auto tuples = header.dimensions[0] * header.dimensions[1] * header.dimensions[2];
+  auto scalars = mapArray(entry, header.scalarsOffset, header.scalarType, header.components, tuples);
+  if(!scalars) return nullptr;
+
+  auto image = vtkSmartPointer<vtkImageData>::New();
+  image->SetDimensions(header.dimensions[0], header.dimensions[1], header.dimensions[2]);
+  image->SetSpacing(header.spacing);
+  image->SetOrigin(header.origin);
+  image->GetPointData()->SetScalars(scalars);
+
+  return image;
+}
+
+//--------------------------------------------------------------------
+bool ResourceCache::storeImage(const QString &source, const QString &variant, vtkImageData *image) const
+{
+  if(!image || !image->GetPointData()->GetScalars()) return false;
+
+  Header header;
+  if(!initHeader(header, source, Kind::IMAGE, m_abort)) return false;
+
+  auto scalars = image->GetPointData()->GetScalars();
+  int dimensions[3];
+  image->GetDimensions(dimensions);
+  image->GetSpacing(header.spacing);
+  image->GetOrigin(header.origin);
+
+  for(int i: {0,1,2}) header.dimensions[i] = dimensions[i];
+  header.scalarType    = scalars->GetDataType();
+  header.components    = scalars->GetNumberOfComponents();
+  header.scalarsOffset = aligned(sizeof(Header));
+
+  const qint64 size = scalars->GetNumberOfValues() * scalars->GetDataTypeSize();
+
+  QSaveFile file{entryName(source, variant)};
+  if(!file.open(QIODevice::WriteOnly)) return false;
+
+  auto result = writeBlock(file, 0, &header, sizeof(Header));
+  result &= writeBlock(file, header.scalarsOffset, scalars->GetVoidPointer(0), size);
+
+  if(!result)
+  {
+    qDebug() << "ResourceCache - can't write image entry of" << source;
+    file.cancelWriting();
+  }
+
+  return file.commit() && result;
+}
+
+//--------------------------------------------------------------------
+QString ResourceCache::bricked(const QString &source, const QString &variant) const
+{
+  auto entry = entryName(source, variant);
+
+  Header header;
+  if(!readHeader(entry, source, Kind::BRICKED, header, m_abort)) return QString();
+
+  // the entry is written after the bricked file, if valid the file is complete.
+  auto filename = QFileInfo{entry}.path() + "/" + QFileInfo{entry}.completeBaseName() + ".bvol";
+  if(!QFileInfo{filename}.exists()) return QString();
+
+  return filename;
+}
+
+//--------------------------------------------------------------------
+QString ResourceCache::storeBricked(const QString &source, const QString &variant, vtkImageData *image) const
+{
+  if(!image || !image->GetPointData()->GetScalars()) return QString();
+
+  Header header;
+  if(!initHeader(header, source, Kind::BRICKED, m_abort)) return QString();
+
+  int dimensions[3];
+  image->GetDimensions(dimensions);
+  image->GetSpacing(header.spacing);
+  image->GetOrigin(header.origin);
+
+  for(int i: {0,1,2}) header.dimensions[i] = dimensions[i];
+  header.scalarType = image->GetScalarType();
+  header.components = image->GetNumberOfScalarComponents();
+
+  auto entry    = entryName(source, variant);
+  auto filename = QFileInfo{entry}.path() + "/" + QFileInfo{entry}.completeBaseName() + ".bvol";
+
+  if(!BrickedVolume::write(image, filename))
+  {
+    qDebug() << "ResourceCache - can't write bricked volume of" << source;
+    return QString();
+  }
+
+  QSaveFile file{entry};
+  if(!file.open(QIODevice::WriteOnly)) return QString();
+
+  if(!writeBlock(file, 0, &header, sizeof(Header)))
+  {
+    qDebug() << "ResourceCache - can't write bricked entry of" << source;
+    file.cancelWriting();
+  }
+
+  return file.commit() ? filename : QString();
+}
@@ -0,0 +1,122 @@
+/*
+ File: ResourceCache.h
+ Created on: 18/10/2026
+ Author: agent
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RESOURCECACHE_H_
+#define RESOURCECACHE_H_
+
+// VTK
+#include <vtkSmartPointer.h>
+
+// Qt
+#include <QString>
+
+// C++
+#include <atomic>
+
+class vtkImageData;
+class vtkPolyData;
+
+/** \class ResourceCache
+ * \brief Disk cache of processed resources in a flat binary format that can be mapped back in memory without
+ * decoding. Each entry is identified by the source file and a variant string describing the processing applied
+ * to it, and it's valid while the source file size, modification time (or contents hash) and the cache version
+ * match. Entries with an empty source name are identified only by their variant, that must then describe the
+ * contents completely (e.g. include a hash of the input data). Images can also be stored as bricked volumes,
+ * written next to their entry, to be rendered out-of-core.
+ *
+ */
+class ResourceCache
+{
+  public:
+    /** \brief ResourceCache class constructor.
+     * \param[in] directory cache directory, the 'cache' directory in the application path if empty.
+     *
+     */
+    explicit ResourceCache(const QString &directory = QString());
+
+    /** \brief Sets the flag checked while reading source files, if set the operation is cancelled.
+     * \param[in] flag abort flag pointer or nullptr to never abort.
+     *
+     */
+    void setAbortFlag(const std::atomic<bool> *flag)
+    { m_abort = flag; }
+
+    /** \brief Returns the cached mesh of the given source file and variant or nullptr if not cached or not valid.
+     *         Only points, point normals and cells are cached.
+     * \param[in] source source file name.
+     * \param[in] variant processing description.
+     *
+     */
+    vtkSmartPointer<vtkPolyData> mesh(const QString &source, const QString &variant) const;
+
+    /** \brief Stores the given mesh in the cache. Returns true on success and false otherwise.
+     * \param[in] source source file name.
+     * \param[in] variant processing description.
+     * \param[in] mesh processed mesh.
+     *
+     */
+    bool storeMesh(const QString &source, const QString &variant, vtkPolyData *mesh) const;
+
+    /** \brief Returns the cached image of the given source file and variant or nullptr if not cached or not valid.
+     * \param[in] source source file name.
+     * \param[in] variant processing description.
+     *
+     */
+    vtkSmartPointer<vtkImageData> image(const QString &source, const QString &variant) const;
+
+    /** \brief Stores the given image in the cache. Returns true on success and false otherwise.
+     * \param[in] source source file name.
+     * \param[in] variant processing description.
+     * \param[in] image processed image.
+     *
+     */
+    bool storeImage(const QString &source, const QString &variant, vtkImageData *image) const;
+
+    /** \brief Returns the file name of the cached bricked volume of the given source file and variant or an empty
+     *         string if not cached or not valid.
+     * \param[in] source source file name.
+     * \param[in] variant processing description.
+     *
+     */
+    QString bricked(const QString &source, const QString &variant) const;
+
+    /** \brief Stores the given image in the cache as a bricked volume. Returns the bricked volume file name on
+     *         success and an empty string otherwise.
+     * \param[in] source source file name.
+     * \param[in] variant processing description.
+     * \param[in] image processed image.
+     *
+     */
+    QString storeBricked(const QString &source, const QString &variant, vtkImageData *image) const;
+
+    static const unsigned int VERSION; /** cache version, must be increased if the loader processing changes. */
+
+  private:
+    /** \brief Returns the name of the cache entry file of the given source and variant.
+     * \param[in] source source file name.
+     * \param[in] variant processing description.
+     *
+     */
+    QString entryName(const QString &source, const QString &variant) const;
+
+    QString                  m_directory; /** cache directory.                  */
+    const std::atomic<bool> *m_abort;     /** abort flag or nullptr if not set. */
+};
+
+#endif // RESOURCECACHE_H_
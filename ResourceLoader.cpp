@@ -20,6 +20,7 @@
 // Project
 #include <ResourceLoader.h>
 #include "Utils.h"
+#include "ResourceRegistry.h"
 
 // Qt
 #include <QCoreApplication>
@@ -30,7 +31,6 @@
 #include <QDebug>
 
 // VTK
-#include <vtkActor2D.h>
 #include <vtkVolume.h>
 #include <vtkPlane.h>
 #include <vtkImageData.h>
@@ -45,7 +45,6 @@
 #include <vtkPiecewiseFunction.h>
 #include <vtkColorTransferFunction.h>
 #include <vtkPNGReader.h>
-#include <vtkImageMapper.h>
 #include <vtkMetaImageWriter.h>
 #include <vtkMetaImageReader.h>
 #include <vtkClipPolyData.h>
@@ -59,59 +58,180 @@
 #include <vtkPoints.h>
 #include <vtkImageResize.h>
 #include <vtkImageInterpolator.h>
+#include <vtkCallbackCommand.h>
+#include <vtkQuadricDecimation.h>
+#include <vtkTriangleFilter.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
 
 // ITK
 #include <itkImage.h>
-#include <itkImageRegionIteratorWithIndex.h>
 #include <itkImageFileReader.h>
-#include <itkImageFileWriter.h>
-#include <itkFlipImageFilter.h>
+#include <itkImageIOBase.h>
+
+// C++
+#include <algorithm>
+
+// ACTORS REPOSITION (centers are in 0,0,0 for an easier rotation).
+// Values have been previously precomputed for the scene to rotate
+// the volumes and meshes in 0,0,0.
+const double CENTER[3]{90.8, 108.8, 90.8};
+
+// Resources loaded by default, in load order, and their files in the resources directory.
+const QStringList RESOURCES{"brain image", "brain mesh", "mci image", "mci mesh", "logo 0", "logo 1", "logo 2"};
+const QMap<QString, QString> RESOURCE_FILES{ { "brain image", "new_avg-2.mhd" },
+                                             { "brain mesh",  "meshBrain.vtp" },
+                                             { "mci image",   "filtered2.mhd" },
+                                             { "mci mesh",    "meshMCI.vtp" },
+                                             { "logo 0",      "FRS_M_ISCIII_FCIEN2.tif" },
+                                             { "logo 1",      "cajalbbp.png" },
+                                             { "logo 2",      "aa.png" } };
+
+// Statistical map the MCI image is computed from, if enabled.
+const QString STATISTICAL_MAP = "Conversion_to_MCI.nii";
+
+// Ray cast volumes, loaded after the default resources only if enabled.
+const QStringList VOLUMES{"brain volume", "mci volume", "fusion volume"};
+
+// Number of triangles of the mesh levels of detail used while interacting, from finer to coarser.
+const QList<vtkIdType> LOD_TRIANGLES{200000, 50000};
+
+// Number of voxels kept around the non-zero voxels of the cropped volumes.
+const int CROP_MARGIN = 2;
+
+// Fraction of the values left out at each end of the transfer function ramps, so a few outlier voxels don't
+// stretch them.
+const double RAMP_CLIP = 0.001;
+
+// Downsampling factors of the volume resolution levels used while interacting and for draft renders.
+const QList<int> VOLUME_FACTORS{2, 4};
+
+// Maximum size of the input slabs read at once while preprocessing images.
+const unsigned long long ResourceLoaderThread::SLAB_BUDGET = 64 * 1024 * 1024;
+
+// Maximum size of the mapped bricks of each out-of-core volume.
+const unsigned long long ResourceLoaderThread::BRICK_BUDGET = 4ULL * 1024 * 1024 * 1024;
+
+namespace
+{
+  /** \brief Computes the range of values of the transfer function ramps from the given statistics.
+   * \param[in] statistics image values statistics.
+   * \param[out] range ramp start and end values.
+   *
+   */
+  void rampRange(const ImageStatistics &statistics, double range[2])
+  {
+    range[0] = statistics.percentile(RAMP_CLIP);
+    range[1] = std::max(statistics.percentile(1. - RAMP_CLIP), range[0] + 1);
+  }
+
+  /** \brief Returns the property of the brain volume, with linear transfer function ramps over the range of
+   * values of the image.
+   * \param[in] statistics image values statistics.
+   *
+   */
+  vtkSmartPointer<vtkVolumeProperty> brainProperty(const ImageStatistics &statistics)
+  {
+    auto volumeProperty = vtkSmartPointer<vtkVolumeProperty>::New();
+    volumeProperty->ShadeOff();
+    volumeProperty->SetSpecular(0.1);
+    volumeProperty->SetInterpolationTypeToLinear();
+
+    double range[2];
+    rampRange(statistics, range);
+
+    auto compositeOpacity = vtkSmartPointer<vtkPiecewiseFunction>::New();
+    compositeOpacity->AddPoint(range[0], 0.);
+    compositeOpacity->AddPoint(range[1], 1.);
+    volumeProperty->SetScalarOpacity(compositeOpacity); // composite first.
+
+    auto color = vtkSmartPointer<vtkColorTransferFunction>::New();
+    color->AddRGBPoint(range[0], 0.1, 0.1, 0.1);
+    color->AddRGBPoint(range[1], 0.6, 0.6, 0.6);
+    volumeProperty->SetColor(color);
+
+    return volumeProperty;
+  }
+}
 
 //--------------------------------------------------------------------
-void ResourceLoaderThread::run()
+ResourceLoaderThread::~ResourceLoaderThread()
 {
-  // direct path to resources.
-  auto currentDir = QCoreApplication::applicationDirPath() + "/resources/";
-  auto logosofia  = currentDir + "FRS_M_ISCIII_FCIEN2.tif";
-  auto logocajal  = currentDir + "cajalbbp.png";
-  auto logoaa     = currentDir + "aa.png";
+  freeResources();
+  m_resources.clear();
 
-  meshLoader();
+  ResourceRegistry::instance().release();
+}
 
-  if(m_abort)
+//--------------------------------------------------------------------
+void ResourceLoaderThread::run()
+{
+  // 4 images and meshes, the levels of detail of the 2 meshes, 3 logos and the enabled volumes and their levels.
+  // Out-of-core volumes have no levels.
+  QStringList volumes;
+  int volumeResources = 0;
+  for(auto name: VOLUMES)
   {
-    freeResources();
-    return;
+    if(!m_volumeNames.contains(name)) continue;
+
+    volumes << name;
+    volumeResources += (m_outOfCore && name == "brain volume") ? 1 : 1 + VOLUME_FACTORS.size();
   }
 
-  // ACTORS REPOSITION (centers are in 0,0,0 for an easier rotation).
-  // Values have been previously precomputed for the scene to rotate
-  // the volumes and meshes in 0,0,0.
-  const double center[3]{90.8, 108.8, 90.8};
-  double position[3]{-90.8, -108.8, -90.8};
+  m_progressTotal = isPartial() ? m_requested.size() : 7 + 2 * LOD_TRIANGLES.size() + volumeResources;
+  reportProgress(0);
 
-  for(auto vol: m_volumes)
+  // resources in the given order first, then the rest and the volumes, the script doesn't use them.
+  QStringList queue;
+  for(auto name: m_order + RESOURCES + volumes)
   {
-    vol->SetOrigin(center);
-    vol->SetPosition(position);
+    if((RESOURCES.contains(name) || volumes.contains(name)) && isRequested(name) && !queue.contains(name)) queue << name;
   }
 
-  for(auto data: m_polyDatas)
+  auto &registry = ResourceRegistry::instance();
+  registry.setPending(queue);
+
+  while(!queue.isEmpty())
   {
-    double point[3];
-    auto points = data->GetPoints();
-    for(int i = 0; i < points->GetNumberOfPoints(); ++i)
+    if(m_abort)
     {
-      points->GetPoint(i, point);
-      for(auto j: {0,1,2}) point[j] -= center[j];
-      points->SetPoint(i, point);
+      registry.clearPending();
+      m_shared.clear();
+      freeResources();
+      return;
     }
-    data->Modified();
+
+    // resources the script is waiting for go first.
+    auto name = registry.wanted(queue);
+    if(name.isEmpty()) name = queue.first();
+    queue.removeOne(name);
+
+    if(!loadResource(name))
+    {
+      registry.clearPending();
+      m_shared.clear();
+      if(m_abort) freeResources();
+      return;
+    }
+
+    emit resourceLoaded(name);
+  }
+
+  registry.clearPending();
+  m_shared.clear();
+
+  // meshes have been recentered when loaded.
+  double position[3]{-CENTER[0], -CENTER[1], -CENTER[2]};
+
+  for(auto vol: m_volumes)
+  {
+    vol->SetOrigin(CENTER);
+    vol->SetPosition(position);
   }
 
   for(auto actor: m_actors)
   {
-    actor->SetOrigin(center);
+    actor->SetOrigin(CENTER);
     actor->SetPosition(position);
   }
 
@@ -120,24 +240,80 @@ void ResourceLoaderThread::run()
     freeResources();
     return;
   }
+}
 
-  // LOGOS LOADING & ACTOR CREATION
-  QStringList logopics{logosofia, logocajal, logoaa};
-  int xPos = 0; // precomputed value, modify SetPosition() line to reposition the logos.
-  for(auto logo: logopics)
+//--------------------------------------------------------------------
+bool ResourceLoaderThread::loadResource(const QString &name)
+{
+  if(VOLUMES.contains(name))
   {
-    QFileInfo logoImageFile{logo};
-    if(!logoImageFile.exists())
-    {
-      error(QString("Can't find %1").arg(logoImageFile.absoluteFilePath()));
-      return;
-    }
+    const auto loaded = (name == "fusion volume") ? volumeLoaderUSHORT() : volumeLoaderUCHAR(name);
+
+    return loaded && !m_abort;
+  }
+
+  // direct path to resources.
+  auto filename = QCoreApplication::applicationDirPath() + "/resources/" + RESOURCE_FILES.value(name);
+  auto suffix   = QFileInfo{filename}.suffix();
+
+  if(name == "mci image" && m_preprocessMCI)
+  {
+    // computed from the statistical map, read in slabs and handed to VTK without copying it.
+    auto image = imagePreprocessing(true);
+    if(!image) return false;
+
+    // same voxel size as the rest of images of the scene.
+    image->SetSpacing(0.4, 0.4, 0.4);
+
+    const auto source = QFileInfo{QCoreApplication::applicationDirPath() + "/resources/" + STATISTICAL_MAP}.absoluteFilePath();
+    addResource(name, image, QStringList{source});
+
+    if(!m_images.contains(image)) m_images << image;
+  }
+  else if(suffix == "mhd")
+  {
+    auto image = loadImage(name, filename);
+    if(!image) return false;
+
+    if(!m_images.contains(image)) m_images << image;
+  }
+  else if(suffix == "vtp")
+  {
+    auto polydata = loadMesh(name, filename);
+    if(!polydata) return false;
+
+    m_polyDatas << polydata;
+
+    if(!loadMeshLevels(name, filename, polydata)) return false;
+  }
+  else
+  {
+    if(!loadLogo(name, filename)) return false;
+  }
+
+  return !m_abort;
+}
+
+//--------------------------------------------------------------------
+bool ResourceLoaderThread::loadLogo(const QString &name, const QString &logo)
+{
+  QFileInfo logoImageFile{logo};
+  if(!logoImageFile.exists())
+  {
+    error(QString("Can't find %1").arg(logoImageFile.absoluteFilePath()));
+    return false;
+  }
 
-    auto image = vtkSmartPointer<vtkImageData>::New();
+  const QString variant{"cubic x3"};
+  auto image = m_cache.image(logo, variant);
+  if(!image)
+  {
+    image = vtkSmartPointer<vtkImageData>::New();
     if(logoImageFile.suffix() == "tif")
     {
       auto reader = vtkSmartPointer<vtkTIFFReader>::New();
       reader->SetFileName(logo.toStdString().c_str());
+      observe(reader);
       reader->Update();
 
       image->DeepCopy(reader->GetOutput());
@@ -147,6 +323,7 @@ void ResourceLoaderThread::run()
     {
       auto reader = vtkSmartPointer<vtkPNGReader>::New();
       reader->SetFileName(logo.toStdString().c_str());
+      observe(reader);
       reader->Update();
 
       image->DeepCopy(reader->GetOutput());
@@ -159,158 +336,156 @@ void ResourceLoaderThread::run()
     resizer->SetInputData(image);
     resizer->SetInterpolator(interpolator);
     resizer->SetOutputDimensions(image->GetDimensions()[0]*3, image->GetDimensions()[1]*3, 1);
+    observe(resizer);
     resizer->Update();
 
-    auto width = resizer->GetOutput()->GetExtent()[1];
-    image->DeepCopy(resizer->GetOutput());
-
-    auto imageMapper = vtkSmartPointer<vtkImageMapper>::New();
-    imageMapper->SetInputData(image);
-    imageMapper->SetColorWindow(255);
-    imageMapper->SetColorLevel(127.5);
-
-    auto imageActor = vtkSmartPointer<vtkActor2D>::New();
-    imageActor->SetMapper(imageMapper);
-    imageActor->SetPosition(xPos, 0);
+    if(m_abort) return false;
 
-    xPos += width;
+    image->DeepCopy(resizer->GetOutput());
 
-    m_logos << imageActor;
+    m_cache.storeImage(logo, variant, image);
   }
 
-  if(m_abort)
-  {
-    freeResources();
-    return;
-  }
+  addResource(name, image, QStringList{logoImageFile.absoluteFilePath()});
+
+  return true;
 }
 
 //--------------------------------------------------------------------
-void ResourceLoaderThread::volumeLoaderUCHAR()
+bool ResourceLoaderThread::volumeLoaderUCHAR(const QString &name)
 {
   // resources filenames.
   auto currentDir = QCoreApplication::applicationDirPath() + "/resources/";
   auto data1      = currentDir + "new_avg-2.mhd";
   auto data2      = currentDir + "ConvMCI-2.mhd";
 
-  // VOLUME LOADING & ACTOR CREATION
-  QFileInfo imageFile{data1};
-  if(!imageFile.exists())
+  if(name == "brain volume" && m_outOfCore)
   {
-    error(QString("Can't find %1").arg(imageFile.absoluteFilePath()));
-    return;
-  }
-
-  auto imageReader = vtkSmartPointer<vtkMetaImageReader>::New();
-  imageReader->SetFileName(QDir::toNativeSeparators(imageFile.absoluteFilePath()).toStdString().c_str());
-  imageReader->Update();
+    const auto files   = imageFiles(QFileInfo{data1}.absoluteFilePath());
+    const QString variant{"spacing 0.4 bricked"};
 
-  auto image = vtkSmartPointer<vtkImageData>::New();
-  image->DeepCopy(imageReader->GetOutput());
-  image->SetSpacing(0.4, 0.4, 0.4);
-
-  m_images << image;
-
-  auto volumeMapper = vtkSmartPointer<vtkFixedPointVolumeRayCastMapper>::New();
-  volumeMapper->SetBlendModeToMaximumIntensity();
-  volumeMapper->SetInputData(image);
-
-  auto volumeProperty = vtkSmartPointer<vtkVolumeProperty>::New();
-  volumeProperty->ShadeOff();
-  volumeProperty->SetSpecular(0.1);
-  volumeProperty->SetInterpolationTypeToLinear();
+    // the bricked copy is written to the cache the first time, then only the bricks in view are mapped.
+    auto filename = m_cache.bricked(files.first(), variant);
+    if(filename.isEmpty())
+    {
+      auto image = sharedImage(name, data1, false);
+      if(!image) return false;
+
+      filename = m_cache.storeBricked(files.first(), variant, image);
+      if(filename.isEmpty())
+      {
+        error(QString("Can't write the bricked volume of %1").arg(files.first()));
+        return false;
+      }
+    }
 
-  auto compositeOpacity = vtkSmartPointer<vtkPiecewiseFunction>::New();
-  for(int i = 0; i < 256; ++i)
-  {
-    compositeOpacity->AddPoint(i, static_cast<double>(i)/255.);
+    return loadBrickedVolume(name, filename, files);
   }
-  volumeProperty->SetScalarOpacity(compositeOpacity); // composite first.
 
-  auto color = vtkSmartPointer<vtkColorTransferFunction>::New();
-  for(auto i = 0; i < 256; ++i)
+  if(name == "brain volume")
   {
-    auto value = static_cast<double>(i)*0.5 + (255.*0.1);
-    color->AddRGBPoint(i,  value/255., value/255., value/255.);
-  }
-  volumeProperty->SetColor(color);
+    // VOLUME LOADING & ACTOR CREATION
+    auto image = loadImage(name, data1);
+    if(!image) return false;
 
-  auto volume = vtkSmartPointer<vtkVolume>::New();
-  volume->SetMapper(volumeMapper);
-  volume->SetProperty(volumeProperty);
+    if(!m_images.contains(image)) m_images << image;
 
-  m_volumes << volume;
+    auto volumeMapper = vtkSmartPointer<vtkFixedPointVolumeRayCastMapper>::New();
+    volumeMapper->SetBlendModeToMaximumIntensity();
+    volumeMapper->SetInputData(image);
 
-  // MCI
-  imageFile = QFileInfo{data2};
-  if(!imageFile.exists())
-  {
-    error(QString("Can't find %1").arg(imageFile.absoluteFilePath()));
-    return;
-  }
+    auto volume = vtkSmartPointer<vtkVolume>::New();
+    volume->SetMapper(volumeMapper);
+    volume->SetProperty(brainProperty(imageStatistics(image, false)));
 
-  imageReader = vtkSmartPointer<vtkMetaImageReader>::New();
-  imageReader->SetFileName(QDir::toNativeSeparators(imageFile.absoluteFilePath()).toStdString().c_str());
-  imageReader->Update();
+    m_volumes << volume;
 
-  image = vtkSmartPointer<vtkImageData>::New();
-  image->DeepCopy(imageReader->GetOutput());
-  image->SetSpacing(0.4, 0.4, 0.4);
+    return loadVolumeLevels(name, imageFiles(QFileInfo{data1}.absoluteFilePath()), volume, image, Pooling::MAXIMUM);
+  }
 
-  m_images << image;
+  // MCI
+  // mostly zero voxels, that are transparent.
+  auto image = loadImage(name, data2, true);
+  if(!image) return false;
+
+  if(!m_images.contains(image)) m_images << image;
 
-  volumeMapper = vtkSmartPointer<vtkFixedPointVolumeRayCastMapper>::New();
+  auto volumeMapper = vtkSmartPointer<vtkFixedPointVolumeRayCastMapper>::New();
   volumeMapper->SetBlendModeToComposite();
   volumeMapper->SetInputData(image);
 
-  volumeProperty = vtkSmartPointer<vtkVolumeProperty>::New();
+  auto volumeProperty = vtkSmartPointer<vtkVolumeProperty>::New();
   volumeProperty->ShadeOff();
   volumeProperty->SetSpecular(0.2);
   volumeProperty->SetInterpolationTypeToLinear();
 
-  compositeOpacity = vtkSmartPointer<vtkPiecewiseFunction>::New();
+  // zero is transparent, the rest of the values range is opaque and mapped to hue.
+  auto statistics = imageStatistics(image, true);
+
+  double range[2];
+  rampRange(statistics, range);
+
+  auto compositeOpacity = vtkSmartPointer<vtkPiecewiseFunction>::New();
   compositeOpacity->AddPoint(0, 0);
-  for(int i = 1; i < 256; ++i)
-  {
-    compositeOpacity->AddPoint(i, 1.);
-  }
+  compositeOpacity->AddPoint(std::max(1., statistics.min), 1.);
+  compositeOpacity->AddPoint(std::max(1., statistics.max), 1.);
   volumeProperty->SetScalarOpacity(compositeOpacity); // composite first.
 
-  color = vtkSmartPointer<vtkColorTransferFunction>::New();
+  auto color = vtkSmartPointer<vtkColorTransferFunction>::New();
   for(auto i = 0; i < 256; ++i)
   {
     auto qColor = QColor::fromHsv(i, 255, 255, 255);
-    color->AddRGBPoint(i,  qColor.redF(), qColor.greenF(), qColor.blueF());
+    color->AddRGBPoint(range[0] + (range[1] - range[0]) * i / 255.,  qColor.redF(), qColor.greenF(), qColor.blueF());
   }
   volumeProperty->SetColor(color);
 
-  volume = vtkSmartPointer<vtkVolume>::New();
+  auto volume = vtkSmartPointer<vtkVolume>::New();
   volume->SetMapper(volumeMapper);
   volume->SetProperty(volumeProperty);
 
   m_volumes << volume;
+
+  return loadVolumeLevels(name, imageFiles(QFileInfo{data2}.absoluteFilePath()), volume, image, Pooling::AVERAGE);
 }
 
 //--------------------------------------------------------------------
-void ResourceLoaderThread::volumeLoaderUSHORT()
+bool ResourceLoaderThread::volumeLoaderUSHORT()
 {
   auto currentDir = QCoreApplication::applicationDirPath() + "/resources/";
-  auto data       = currentDir + "fusion.mhd";
+  auto data1      = currentDir + "new_avg-2.mhd";
+  auto data2      = currentDir + "ConvMCI-2.mhd";
 
-  auto imageFile = QFileInfo{data};
-  if(!imageFile.exists())
+  const QStringList files = imageFiles(QFileInfo{data1}.absoluteFilePath()) + imageFiles(QFileInfo{data2}.absoluteFilePath());
+  const auto parameters   = QString("fusion %1 threshold %2%3 cropped").arg(QFileInfo{data2}.absoluteFilePath())
+                            .arg(m_fusionRule.threshold).arg(m_fusionRule.insideAnatomy ? " inside anatomy" : "");
+
+  // the fused volume is computed from the full anatomy and MCI volumes, shared with the rest of resources. The MCI
+  // values get the same hues as in the MCI volume.
+  auto mci = sharedImage("fusion volume", data2, false);
+  if(!mci) return false;
+
+  double hueRange[2];
+  rampRange(imageStatistics(mci, true), hueRange);
+
+  auto &registry = ResourceRegistry::instance();
+  auto image = registry.find<vtkImageData>(data1, parameters);
+  if(!image)
   {
-    error(QString("Can't find %1").arg(imageFile.absoluteFilePath()));
-    return;
-  }
+    auto anatomy = sharedImage("fusion volume", data1, false);
+    if(!anatomy) return false;
 
-  auto imageReader = vtkSmartPointer<vtkMetaImageReader>::New();
-  imageReader->SetFileName(QDir::toNativeSeparators(imageFile.absoluteFilePath()).toStdString().c_str());
-  imageReader->Update();
+    image = fuseVolumes(anatomy, mci, m_fusionRule);
+    if(!image)
+    {
+      error(QString("Can't fuse %1 and %2, they must be unsigned char volumes of the same size.").arg(data1).arg(data2));
+      return false;
+    }
+    image = cropImage("fusion volume", image);
+
+    registry.insert(data1, parameters, image, files);
+  }
 
-  auto image = vtkSmartPointer<vtkImageData>::New();
-  image->DeepCopy(imageReader->GetOutput());
-  image->SetSpacing(0.4, 0.4, 0.4);
+  addResource("fusion volume", image, files);
 
   m_images << image;
 
@@ -347,7 +522,8 @@ void ResourceLoaderThread::volumeLoaderUSHORT()
     }
     else
     {
-      auto qColor = QColor::fromHsv(i-256, 255, 255, 255);
+      const auto hue = 255. * (i - 256 - hueRange[0]) / (hueRange[1] - hueRange[0]);
+      auto qColor = QColor::fromHsv(static_cast<int>(std::min(255., std::max(0., hue))), 255, 255, 255);
       color->AddRGBPoint(i,  qColor.redF(), qColor.greenF(), qColor.blueF());
     }
   }
@@ -358,147 +534,521 @@ void ResourceLoaderThread::volumeLoaderUSHORT()
   volume->SetProperty(volumeProperty);
 
   m_volumes << volume;
+
+  // values encode two ranges, averaging would mix them. Not cached, depends on both files and the rule.
+  return loadVolumeLevels("fusion volume", files, volume, image, Pooling::MAXIMUM, false);
 }
 
 //--------------------------------------------------------------------
-void ResourceLoaderThread::meshLoader()
+vtkSmartPointer<vtkImageData> ResourceLoaderThread::loadImage(const QString &name, const QString &filename, const bool crop)
 {
-  // resources filenames.
-  auto currentDir = QCoreApplication::applicationDirPath() + "/resources/";
-  auto data1      = currentDir + "new_avg-2.mhd";
-  auto data2      = currentDir + "filtered2.mhd";
-  auto mesh1      = currentDir + "meshBrain.vtp";
-  auto mesh2      = currentDir + "meshMCI.vtp";
+  auto image = sharedImage(name, filename, crop);
+  if(!image) return nullptr;
 
-  // VOLUME LOADING & ACTOR CREATION
-  QFileInfo imageFile{data1};
+  addResource(name, image, imageFiles(QFileInfo{filename}.absoluteFilePath()));
+
+  return image;
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkImageData> ResourceLoaderThread::sharedImage(const QString &name, const QString &filename, const bool crop)
+{
+  QFileInfo imageFile{filename};
   if(!imageFile.exists())
   {
     error(QString("Can't find %1").arg(imageFile.absoluteFilePath()));
-    return;
+    return nullptr;
   }
 
-  auto imageReader = vtkSmartPointer<vtkMetaImageReader>::New();
-  imageReader->SetFileName(QDir::toNativeSeparators(imageFile.absoluteFilePath()).toStdString().c_str());
-  imageReader->Update();
+  const auto parameters = QString("spacing 0.4%1").arg(crop ? " cropped" : "");
 
-  auto image = vtkSmartPointer<vtkImageData>::New();
-  image->DeepCopy(imageReader->GetOutput());
-  image->SetSpacing(0.4, 0.4, 0.4);
+  auto &registry = ResourceRegistry::instance();
+  auto image = registry.find<vtkImageData>(imageFile.absoluteFilePath(), parameters);
+  if(image) return image;
 
-  m_images << image;
+  if(crop)
+  {
+    auto full = sharedImage(name, filename, false);
+    if(!full) return nullptr;
+
+    // kept until the run ends, otherwise the registry drops it and later loads of the file read it again.
+    if(!m_shared.contains(full)) m_shared << full;
+
+    image = cropImage(name, full);
+  }
+  else
+  {
+    image = loadMetaImage(imageFile.absoluteFilePath(), progressObserver());
+    if(m_abort) return nullptr;
+
+    if(!image)
+    {
+      error(QString("Can't load %1").arg(imageFile.absoluteFilePath()));
+      return nullptr;
+    }
+    image->SetSpacing(0.4, 0.4, 0.4);
+  }
+
+  registry.insert(imageFile.absoluteFilePath(), parameters, image, imageFiles(imageFile.absoluteFilePath()));
+
+  return image;
+}
+
+//--------------------------------------------------------------------
+bool ResourceLoaderThread::loadBrickedVolume(const QString &name, const QString &filename, const QStringList &files)
+{
+  auto bricked = std::make_shared<BrickedVolume>(filename, m_brickBudget);
+  if(!bricked->isValid())
+  {
+    error(QString("Can't read bricked volume %1").arg(QFileInfo{filename}.absoluteFilePath()));
+    return false;
+  }
+
+  // the voxels aren't read, the statistics were computed when the bricked volume was written.
+  bricked->setProperty(brainProperty(bricked->statistics()));
+  bricked->setBlendMode(vtkVolumeMapper::MAXIMUM_INTENSITY_BLEND);
+
+  m_volumes << bricked->volumes();
+  m_bricked << bricked;
+
+  ++m_progressDone;
+  reportProgress(0);
+
+  for(auto file: files)
+  {
+    if(!m_dependencies[file].contains(name)) m_dependencies[file] << name;
+  }
 
-  QFileInfo meshFile{mesh1};
+  return true;
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> ResourceLoaderThread::loadMesh(const QString &name, const QString &filename)
+{
+  QFileInfo meshFile{filename};
   if(!meshFile.exists())
   {
     error(QString("Can't find %1").arg(meshFile.absoluteFilePath()));
-    return;
+    return nullptr;
   }
 
-  auto meshReader = vtkSmartPointer<vtkXMLPolyDataReader>::New();
-  meshReader->SetFileName(meshFile.absoluteFilePath().toStdString().c_str());
-  meshReader->Update();
+  const auto variant = QString("recentered %1 %2 %3%4").arg(CENTER[0]).arg(CENTER[1]).arg(CENTER[2]).arg(m_optimizeMeshes ? " optimized" : "");
 
-  auto polydata = vtkSmartPointer<vtkPolyData>::New();
-  polydata->DeepCopy(meshReader->GetOutput());
+  auto &registry = ResourceRegistry::instance();
+  auto polydata = registry.find<vtkPolyData>(meshFile.absoluteFilePath(), variant);
+  if(!polydata) polydata = m_cache.mesh(meshFile.absoluteFilePath(), variant);
+  if(!polydata)
+  {
+    auto meshReader = vtkSmartPointer<vtkXMLPolyDataReader>::New();
+    meshReader->SetFileName(meshFile.absoluteFilePath().toStdString().c_str());
+    observe(meshReader);
+    meshReader->Update();
 
-  m_polyDatas << polydata;
+    // an aborted read leaves a partial mesh, it must not be cached.
+    if(m_abort) return nullptr;
 
-  // MCI
-  imageFile = QFileInfo{data2};
-  if(!imageFile.exists())
+    polydata = vtkSmartPointer<vtkPolyData>::New();
+    polydata->DeepCopy(meshReader->GetOutput());
+    recenter(polydata);
+
+    if(m_optimizeMeshes && !m_abort)
+    {
+      const auto points = polydata->GetNumberOfPoints();
+      const auto cells  = polydata->GetNumberOfCells();
+
+      polydata = optimizeMesh(polydata);
+      if(!polydata)
+      {
+        error(QString("Can't optimize mesh %1").arg(meshFile.absoluteFilePath()));
+        return nullptr;
+      }
+
+      qDebug() << QString("%1 optimized: %2 points and %3 cells to %4 points and %5 strips").arg(name).arg(points)
+                  .arg(cells).arg(polydata->GetNumberOfPoints()).arg(polydata->GetNumberOfStrips());
+    }
+
+    if(m_abort) return nullptr;
+
+    m_cache.storeMesh(meshFile.absoluteFilePath(), variant, polydata);
+  }
+
+  registry.insert(meshFile.absoluteFilePath(), variant, polydata);
+
+  addResource(name, polydata, QStringList{meshFile.absoluteFilePath()});
+
+  return polydata;
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkImageData> ResourceLoaderThread::cropImage(const QString &name, vtkImageData *image)
+{
+  auto cropped = cropToNonZero(image, CROP_MARGIN);
+  if(!cropped || cropped == image) return image;
+
+  const auto voxels = image->GetNumberOfPoints();
+  const auto saved  = voxels - cropped->GetNumberOfPoints();
+  const auto bytes  = static_cast<double>(saved) * image->GetScalarSize() * image->GetNumberOfScalarComponents();
+
+  qDebug() << QString("%1 cropped to %2x%3x%4, %5% of the voxels removed (%6 MB)").arg(name)
+              .arg(cropped->GetDimensions()[0]).arg(cropped->GetDimensions()[1]).arg(cropped->GetDimensions()[2])
+              .arg(100. * saved / voxels, 0, 'f', 1).arg(bytes / (1024.*1024.), 0, 'f', 1);
+
+  return cropped;
+}
+
+//--------------------------------------------------------------------
+QStringList ResourceLoaderThread::imageFiles(const QString &filename) const
+{
+  QStringList files{filename};
+
+  auto dataFile = metaImageDataFile(filename);
+  if(!dataFile.isEmpty() && !files.contains(dataFile)) files << dataFile;
+
+  return files;
+}
+
+//--------------------------------------------------------------------
+bool ResourceLoaderThread::loadMeshLevels(const QString &name, const QString &filename, vtkPolyData *mesh)
+{
+  const auto source = QFileInfo{filename}.absoluteFilePath();
+
+  // the decimation needs triangles, optimized meshes are strips.
+  vtkSmartPointer<vtkPolyData> input = mesh;
+  if(mesh->GetNumberOfStrips() > 0)
   {
-    error(QString("Can't find %1").arg(imageFile.absoluteFilePath()));
-    return;
+    auto triangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
+    triangleFilter->SetInputData(mesh);
+    triangleFilter->Update();
+
+    input = triangleFilter->GetOutput();
   }
 
-  imageReader = vtkSmartPointer<vtkMetaImageReader>::New();
-  imageReader->SetFileName(QDir::toNativeSeparators(imageFile.absoluteFilePath()).toStdString().c_str());
-  imageReader->Update();
+  const auto triangles = input->GetNumberOfPolys();
 
-  image = vtkSmartPointer<vtkImageData>::New();
-  image->DeepCopy(imageReader->GetOutput());
-  image->SetSpacing(0.4, 0.4, 0.4);
+  QList<vtkSmartPointer<vtkPolyData>> levels;
+  for(int i = 0; i < LOD_TRIANGLES.size(); ++i)
+  {
+    const auto levelName = QString("%1 lod %2").arg(name).arg(i + 1);
+    if(!isRequested(levelName)) continue;
+
+    const auto variant = QString("recentered %1 %2 %3%4 quadric %5").arg(CENTER[0]).arg(CENTER[1]).arg(CENTER[2])
+                         .arg(m_optimizeMeshes ? " optimized" : "").arg(LOD_TRIANGLES.at(i));
+    auto level = ResourceRegistry::instance().find<vtkPolyData>(source, variant);
+    if(!level) level = m_cache.mesh(source, variant);
+    if(!level)
+    {
+      // meshes smaller than the target are kept, but still decimated to remove the point attributes.
+      const auto reduction = triangles > LOD_TRIANGLES.at(i) ? 1. - static_cast<double>(LOD_TRIANGLES.at(i))/triangles : 0.;
+
+      auto decimator = vtkSmartPointer<vtkQuadricDecimation>::New();
+      decimator->SetInputData(input);
+      decimator->SetTargetReduction(reduction);
+      decimator->VolumePreservationOn();
+      observe(decimator);
+
+      auto normals = vtkSmartPointer<vtkPolyDataNormals>::New();
+      normals->SetInputConnection(decimator->GetOutputPort());
+      normals->SplittingOff();
+      normals->ConsistencyOn();
+      normals->ComputePointNormalsOn();
+      normals->ComputeCellNormalsOff();
+      observe(normals);
+      normals->Update();
+
+      if(m_abort) return false;
+
+      level = vtkSmartPointer<vtkPolyData>::New();
+      level->DeepCopy(normals->GetOutput());
+
+      m_cache.storeMesh(source, variant, level);
+    }
 
-  m_images << image;
+    ResourceRegistry::instance().insert(source, variant, level);
 
-  meshFile = QFileInfo{mesh2};
-  if(!meshFile.exists())
+    addResource(levelName, level, QStringList{source});
+
+    levels << level;
+  }
+
+  m_meshLevels.insert(name, levels);
+
+  return true;
+}
+
+//--------------------------------------------------------------------
+bool ResourceLoaderThread::loadVolumeLevels(const QString &name, const QStringList &files, vtkVolume *volume, vtkImageData *image, const Pooling pooling, const bool useCache)
+{
+  const auto source = files.first();
+  const auto bytes  = [](vtkImageData *data) { return data->GetPointData()->GetScalars()->GetDataSize() * data->GetScalarSize(); };
+
+  QList<vtkSmartPointer<vtkImageData>> levels{image};
+  int previousFactor = 1;
+  qDebug() << QString("%1 full resolution: %2 MB").arg(name).arg(bytes(image)/(1024.*1024.), 0, 'f', 1);
+
+  for(auto factor: VOLUME_FACTORS)
   {
-    error(QString("Can't find %1").arg(meshFile.absoluteFilePath()));
-    return;
+    const auto levelName = QString("%1 %2x").arg(name).arg(factor);
+    if(!isRequested(levelName)) continue;
+
+    // the dimensions tell apart cropped and full images.
+    const auto variant = QString("spacing 0.4 dimensions %1x%2x%3 %4 %5x").arg(image->GetDimensions()[0]).arg(image->GetDimensions()[1])
+                         .arg(image->GetDimensions()[2]).arg(pooling == Pooling::MAXIMUM ? "maximum" : "average").arg(factor);
+    vtkSmartPointer<vtkImageData> level = nullptr;
+    if(useCache)
+    {
+      level = ResourceRegistry::instance().find<vtkImageData>(source, variant);
+      if(!level) level = m_cache.image(source, variant);
+    }
+
+    if(!level)
+    {
+      // computed from the previous level if possible, it's smaller.
+      if(factor % previousFactor == 0)
+      {
+        level = downsampleImage(levels.last(), factor / previousFactor, pooling);
+      }
+      else
+      {
+        level = downsampleImage(image, factor, pooling);
+      }
+
+      if(!level)
+      {
+        error(QString("Can't downsample %1").arg(name));
+        return false;
+      }
+
+      if(m_abort) return false;
+
+      if(useCache) m_cache.storeImage(source, variant, level);
+    }
+
+    if(useCache) ResourceRegistry::instance().insert(source, variant, level, files);
+
+    addResource(levelName, level, files);
+
+    const auto voxels = static_cast<double>(image->GetNumberOfPoints()) / level->GetNumberOfPoints();
+    qDebug() << QString("%1 level %2x: %3 MB, %4 times less voxels to ray cast").arg(name).arg(factor)
+                .arg(bytes(level)/(1024.*1024.), 0, 'f', 1).arg(voxels, 0, 'f', 1);
+
+    levels << level;
+    previousFactor = factor;
   }
 
-  meshReader = vtkSmartPointer<vtkXMLPolyDataReader>::New();
-  meshReader->SetFileName(meshFile.absoluteFilePath().toStdString().c_str());
-  meshReader->Update();
+  m_volumeLevels.insert(volume, levels);
+
+  return true;
+}
+
+//--------------------------------------------------------------------
+void ResourceLoaderThread::addResource(const QString &name, vtkDataObject *data, const QStringList &files)
+{
+  m_resources.insert(name, data);
+  ResourceRegistry::instance().setName(name, data);
 
-  polydata = vtkSmartPointer<vtkPolyData>::New();
-  polydata->DeepCopy(meshReader->GetOutput());
+  ++m_progressDone;
+  reportProgress(0);
 
-  m_polyDatas << polydata;
+  for(auto file: files)
+  {
+    if(!m_dependencies[file].contains(name)) m_dependencies[file] << name;
+  }
 }
 
 //--------------------------------------------------------------------
-void ResourceLoaderThread::imagePreprocessing()
+vtkSmartPointer<vtkImageData> ResourceLoaderThread::imagePreprocessing(const bool useCache, vtkMatrix4x4 *direction)
 {
   auto currentDir = QCoreApplication::applicationDirPath() + "/resources/";
-  auto data1      = currentDir + "Conversion_to_MCI.nii";
+  auto data1      = currentDir + STATISTICAL_MAP;
+
+  QFileInfo mapFile{data1};
+  if(!mapFile.exists())
+  {
+    error(QString("Can't find %1").arg(mapFile.absoluteFilePath()));
+    return nullptr;
+  }
+
+  const QString variant = "quantized 4.67 6.17444 flipped x";
+
+  // cached images don't keep the direction.
+  if(useCache && !direction)
+  {
+    auto cached = m_cache.image(data1, variant);
+    if(cached) return cached;
+  }
 
   using FloatType = itk::Image<float, 3>;
   using ImageType = itk::Image<unsigned char, 3>;
 
   auto reader = itk::ImageFileReader<FloatType>::New();
   reader->SetFileName(data1.toStdString().c_str());
-  reader->Update();
 
-  auto image = reader->GetOutput();
-  auto it = itk::ImageRegionIteratorWithIndex<FloatType>(image, image->GetLargestPossibleRegion());
-  it.GoToBegin();
+  try
+  {
+    reader->UpdateOutputInformation();
+  }
+  catch(const itk::ExceptionObject &e)
+  {
+    error(QString("Can't read %1: %2").arg(mapFile.absoluteFilePath()).arg(e.GetDescription()));
+    return nullptr;
+  }
+
+  // without it the image IO reads the largest region whatever region is requested.
+  reader->GetImageIO()->SetUseStreamedReading(true);
+
+  if(m_abort) return nullptr;
+
+  auto image  = reader->GetOutput();
+  auto region = image->GetLargestPossibleRegion();
+  auto size   = region.GetSize();
+
+  // Output is the quantized input flipped in the X axis, with the origin FlipImageFilter computes when flipping
+  // about the origin.
+  auto origin = image->GetOrigin();
+  origin[0] = -(origin[0] + (size[0] - 1) * image->GetSpacing()[0]);
 
   auto uImage = ImageType::New();
   uImage->SetNumberOfComponentsPerPixel(1);
-  uImage->SetRegions(image->GetLargestPossibleRegion());
+  uImage->SetRegions(region);
   uImage->SetSpacing(image->GetSpacing());
-  uImage->SetOrigin(image->GetOrigin());
-  uImage->Allocate(true);
-  auto uit = itk::ImageRegionIteratorWithIndex<ImageType>(uImage, uImage->GetLargestPossibleRegion());
-  uit.GoToBegin();
+  uImage->SetOrigin(origin);
+  uImage->SetDirection(image->GetDirection());
+  uImage->Allocate();
+
+  const float limit = 4.67;
+  const float shift = limit * 0.99;
+  const float scale = 255. / (6.17444 - limit);
+
+  const auto output    = uImage->GetBufferPointer();
+  const auto rowSize   = static_cast<long long>(size[0]);
+  const auto rows      = static_cast<long long>(size[1]);
+  const auto slices    = static_cast<long long>(size[2]);
+  const auto sliceSize = rowSize * rows;
+
+  // the input is read in z slabs that fit in the budget, the reader reads the whole volume if the file format
+  // doesn't support streaming.
+  auto slabDepth = std::max(1LL, static_cast<long long>(m_slabBudget / (sliceSize * sizeof(float))));
+  if(!reader->GetImageIO()->CanStreamRead()) slabDepth = slices;
+
+  for(long long slab = 0; slab < slices; slab += slabDepth)
+  {
+    const auto depth = std::min(slabDepth, slices - slab);
+
+    auto slabRegion = region;
+    slabRegion.SetIndex(2, region.GetIndex(2) + slab);
+    slabRegion.SetSize(2, depth);
+
+    image->SetRequestedRegion(slabRegion);
 
-  auto adjustFor = [] (double value, const double limit)
+    try
+    {
+      image->Update();
+    }
+    catch(const itk::ExceptionObject &e)
+    {
+      error(QString("Can't read %1: %2").arg(mapFile.absoluteFilePath()).arg(e.GetDescription()));
+      return nullptr;
+    }
+
+    if(m_abort) return nullptr;
+
+    // the buffered region can be larger than the requested one.
+    const auto buffered = image->GetBufferedRegion();
+    const auto input    = image->GetBufferPointer() + (slabRegion.GetIndex(2) - buffered.GetIndex(2)) * sliceSize;
+    const auto target   = output + slab * sliceSize;
+
+    // one fused pass: quantize and write each row in flipped order, slices in parallel.
+    parallelFor(0, depth, [&](const long long first, const long long last)
+    {
+      for(auto z = first; z < last && !m_abort; ++z)
+      {
+        for(long long y = 0; y < rows; ++y)
+        {
+          const auto offset = z * sliceSize + y * rowSize;
+          quantizeFlippedRow(input + offset, target + offset, rowSize, limit, shift, scale);
+        }
+      }
+    });
+
+    if(m_abort) return nullptr;
+
+    reportProgress(static_cast<double>(slab + depth) / slices);
+  }
+
+  // the last slab is released here, the output buffer is shared with the VTK image.
+  reader = nullptr;
+
+  auto result = itkToVTK<ImageType>(uImage, direction);
+
+  if(result && useCache && !direction) m_cache.storeImage(data1, variant, result);
+
+  return result;
+}
+
+//--------------------------------------------------------------------
+void ResourceLoaderThread::recenter(vtkPolyData *mesh)
+{
+  double point[3];
+  auto points = mesh->GetPoints();
+  for(int i = 0; i < points->GetNumberOfPoints(); ++i)
   {
-    value = (value < limit) ? 0. : (value - (limit * 0.99));
-    unsigned char uValue = (value * 255)/(6.17444-limit);
+    if((i % 65536 == 0) && m_abort) return;
 
-    return uValue;
-  };
+    points->GetPoint(i, point);
+    for(auto j: {0,1,2}) point[j] -= CENTER[j];
+    points->SetPoint(i, point);
+  }
+  mesh->Modified();
+}
 
-  while(!it.IsAtEnd())
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkCommand> ResourceLoaderThread::progressObserver()
+{
+  auto command = vtkSmartPointer<vtkCallbackCommand>::New();
+  command->SetCallback(onProgressEvent);
+  command->SetClientData(this);
+
+  return command;
+}
+
+//--------------------------------------------------------------------
+void ResourceLoaderThread::observe(vtkAlgorithm *algorithm)
+{
+  algorithm->AddObserver(vtkCommand::ProgressEvent, progressObserver());
+}
+
+//--------------------------------------------------------------------
+void ResourceLoaderThread::onProgressEvent(vtkObject *caller, unsigned long eventId, void *clientData, void *callData)
+{
+  auto loader    = static_cast<ResourceLoaderThread *>(clientData);
+  auto algorithm = vtkAlgorithm::SafeDownCast(caller);
+
+  if(!loader) return;
+
+  if(loader->m_abort && algorithm)
   {
-    auto value = it.Value();
-    auto uValue = adjustFor(value, 4.67);
-    uit.Set(uValue);
+    algorithm->AbortExecuteOn();
+  }
 
-    ++it;
-    ++uit;
+  if(callData)
+  {
+    loader->reportProgress(*static_cast<double *>(callData));
   }
+}
 
-  itk::FixedArray<bool, 3> flipAxes;
-  flipAxes[0] = true;
-  flipAxes[1] = false;
-  flipAxes[2] = false;
+//--------------------------------------------------------------------
+void ResourceLoaderThread::reportProgress(const double fraction)
+{
+  if(m_progressTotal == 0) return;
 
-  auto flipX = itk::FlipImageFilter<ImageType>::New();
-  flipX->SetFlipAxes(flipAxes);
-  flipX->SetNumberOfThreads(1);
-  flipX->SetInput(uImage);
-  flipX->ReleaseDataFlagOn();
-  flipX->Update();
+  const auto done  = m_progressDone + std::min(1., std::max(0., fraction));
+  const auto value = std::min(100, static_cast<int>(100 * done / m_progressTotal));
 
-  auto writer = itk::ImageFileWriter<ImageType>::New();
-  writer->SetFileName(QString{currentDir + "filtered.mhd"}.toStdString().c_str());
-  writer->SetInput(flipX->GetOutput());
-  writer->Write();
+  if(value != m_progress)
+  {
+    m_progress = value;
+    emit progress(value);
+  }
 }
 
 //--------------------------------------------------------------------
@@ -506,8 +1056,10 @@ void ResourceLoaderThread::freeResources()
 {
   m_actors.clear();
   m_images.clear();
-  m_logos.clear();
   m_planes.clear();
   m_polyDatas.clear();
   m_volumes.clear();
+  m_meshLevels.clear();
+  m_volumeLevels.clear();
+  m_bricked.clear();
 }
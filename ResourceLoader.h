@@ -20,16 +20,31 @@
 #ifndef RESOURCELOADER_H_
 #define RESOURCELOADER_H_
 
+// Project
+#include "ResourceCache.h"
+#include "Utils.h"
+#include "BrickedVolume.h"
+
 // VTK
 #include <vtkSmartPointer.h>
 
 // Qt
 #include <QThread>
 #include <QString>
+#include <QStringList>
 #include <QList>
+#include <QMap>
+
+// C++
+#include <atomic>
+#include <memory>
 
 class vtkActor;
-class vtkActor2D;
+class vtkAlgorithm;
+class vtkCommand;
+class vtkObject;
+
+class vtkDataObject;
 class vtkImageData;
 class vtkVolume;
 class vtkPlane;
@@ -50,14 +65,40 @@ class ResourceLoaderThread
      *
      */
     explicit ResourceLoaderThread(QObject *parent = nullptr)
-    : m_abort{false}
-    {}
+    : m_abort        {false}
+    , m_slabBudget   {SLAB_BUDGET}
+    , m_brickBudget  {BRICK_BUDGET}
+    , m_optimizeMeshes{false}
+    , m_preprocessMCI{false}
+    , m_outOfCore    {false}
+    , m_progressTotal{0}
+    , m_progressDone {0}
+    , m_progress     {-1}
+    { m_cache.setAbortFlag(&m_abort); }
+
+    /** \brief ResourceLoaderThread class constructor for partial reloads.
+     * \param[in] resources names of the resources to load, the rest are skipped.
+     * \param[in] parent raw pointer of the QObject owner of this one.
+     *
+     */
+    explicit ResourceLoaderThread(const QStringList &resources, QObject *parent = nullptr)
+    : m_requested    {resources}
+    , m_abort        {false}
+    , m_slabBudget   {SLAB_BUDGET}
+    , m_brickBudget  {BRICK_BUDGET}
+    , m_optimizeMeshes{false}
+    , m_preprocessMCI{false}
+    , m_outOfCore    {false}
+    , m_progressTotal{0}
+    , m_progressDone {0}
+    , m_progress     {-1}
+    { m_cache.setAbortFlag(&m_abort); }
 
-    /** \brief ResourceLoaderThread class virtual destructor.
+    /** \brief ResourceLoaderThread class virtual destructor. Releases the registry data only used by this
+     * loader.
      *
      */
-    virtual ~ResourceLoaderThread()
-    {}
+    virtual ~ResourceLoaderThread();
 
     /** \brief Returns the list of raw vtkImageData.
      *
@@ -71,12 +112,6 @@ class ResourceLoaderThread
     const QList<vtkSmartPointer<vtkVolume>> volumes() const
     { return m_volumes; }
 
-    /** \brief Returns the list of logos (2D actors).
-     *
-     */
-    const QList<vtkSmartPointer<vtkActor2D>> logos() const
-    { return m_logos; }
-
     /** \brief Returns the list of 3D actors.
      *
      */
@@ -95,13 +130,104 @@ class ResourceLoaderThread
     const QList<vtkSmartPointer<vtkPlane>> planes() const
     { return m_planes; }
 
+    /** \brief Returns the decimated levels of detail of the given mesh resource, from finer to coarser.
+     * \param[in] name mesh resource name.
+     *
+     */
+    const QList<vtkSmartPointer<vtkPolyData>> meshLevels(const QString &name) const
+    { return m_meshLevels.value(name); }
+
+    /** \brief Returns the resolution levels of each volume, the first is the full resolution image and the
+     * next ones are downsampled 2x and 4x.
+     *
+     */
+    const QMap<vtkSmartPointer<vtkVolume>, QList<vtkSmartPointer<vtkImageData>>> volumeLevels() const
+    { return m_volumeLevels; }
+
+    /** \brief Returns the loaded data objects (images, meshes and logo pictures) by resource name.
+     *
+     */
+    const QMap<QString, vtkSmartPointer<vtkDataObject>> resources() const
+    { return m_resources; }
+
+    /** \brief Returns the out-of-core volumes. Their brick volumes are also in the volumes list.
+     *
+     */
+    const QList<std::shared_ptr<BrickedVolume>> brickedVolumes() const
+    { return m_bricked; }
+
+    /** \brief Returns the names of the resources each file on disk is used by.
+     *
+     */
+    const QMap<QString, QStringList> dependencies() const
+    { return m_dependencies; }
+
+    /** \brief Returns true if only a subset of the resources was requested.
+     *
+     */
+    const bool isPartial() const
+    { return !m_requested.isEmpty(); }
+
     /** \brief Returns the error string.
      *
      */
     const QString getError() const
     { return m_error; }
 
-    /** \brief Aborts the loading and frees resources.
+    /** \brief Sets the rule used to compute the fusion volume.
+     * \param[in] rule fusion rule.
+     *
+     */
+    void setFusionRule(const FusionRule &rule)
+    { m_fusionRule = rule; }
+
+    /** \brief Sets the maximum size of the input slabs read while preprocessing images.
+     * \param[in] bytes slab budget in bytes, at least one slice is always read.
+     *
+     */
+    void setSlabBudget(const unsigned long long bytes)
+    { m_slabBudget = bytes; }
+
+    /** \brief Enables or disables the conversion of the loaded meshes to a compact layout for rendering.
+     * \param[in] enabled true to optimize the meshes and false to use them as read.
+     *
+     */
+    void setOptimizeMeshes(const bool enabled)
+    { m_optimizeMeshes = enabled; }
+
+    /** \brief Enables or disables computing the MCI image from the statistical map instead of reading it.
+     * \param[in] enabled true to preprocess the statistical map and false to read the MCI MetaImage.
+     *
+     */
+    void setPreprocessMCI(const bool enabled)
+    { m_preprocessMCI = enabled; }
+
+    /** \brief Sets the ray cast volumes to load after the rest of resources, none are loaded by default.
+     * \param[in] names volume resource names, unknown names are ignored.
+     *
+     */
+    void setVolumes(const QStringList &names)
+    { m_volumeNames = names; }
+
+    /** \brief Sets the memory budget of each out-of-core volume.
+     * \param[in] bytes maximum size of the mapped bricks of a volume in bytes.
+     *
+     */
+    void setBrickBudget(const unsigned long long bytes)
+    { m_brickBudget = bytes; }
+
+    /** \brief Enables or disables rendering the brain volume out-of-core, from a bricked copy in the cache.
+     * \param[in] enabled true to map the bricks on demand and false to load the whole image.
+     *
+     */
+    void setOutOfCore(const bool enabled)
+    { m_outOfCore = enabled; }
+
+    static const unsigned long long SLAB_BUDGET;  /** default preprocessing slab budget in bytes. */
+    static const unsigned long long BRICK_BUDGET; /** default out-of-core volume budget in bytes. */
+
+    /** \brief Aborts the loading and frees resources. Can be called from any thread, the readers in progress
+     * are interrupted.
      *
      */
     void abort()
@@ -110,12 +236,32 @@ class ResourceLoaderThread
     const bool isAborted() const
     { return m_abort; }
 
+    /** \brief Sets the order the resources must be loaded in, usually the order the script uses them. Resources
+     * not in the list are loaded after them. The resources the script waits for are always loaded first.
+     * \param[in] names resource names.
+     *
+     */
+    void setLoadOrder(const QStringList &names)
+    { m_order = names; }
+
   protected:
     virtual void run() override;
 
   signals:
     void finishedLoading();
 
+    /** \brief Signals the loading progress.
+     * \param[in] value progress value in [0,100].
+     *
+     */
+    void progress(int value);
+
+    /** \brief Signals that a resource has been loaded and registered.
+     * \param[in] name resource name.
+     *
+     */
+    void resourceLoaded(const QString &name);
+
   private:
     /** \brief Frees allocated resources.
      *
@@ -129,23 +275,176 @@ class ResourceLoaderThread
     void error(const QString &message)
     { m_error = message; }
 
-    /** \brief Helper method to load some resources. To be able to specify the resources to load.
+    /** \brief Helper methods to load the ray cast volumes and register them and their resolution levels as
+     * resources. Return false on error or if aborted. The unsigned short loader computes the fusion volume.
+     * \param[in] name volume resource name.
+     *
+     */
+    bool volumeLoaderUCHAR(const QString &name);
+    bool volumeLoaderUSHORT();
+
+    /** \brief Quantizes and flips the MCI conversion image and returns it as a VTK image that shares the ITK
+     *         buffer, without writing it to disk. Returns nullptr on error or if aborted.
+     * \param[in] useCache true to look for the result in the resource cache first and store it there afterwards.
+     *            Ignored if the direction is requested, as the cache doesn't store it.
+     * \param[out] direction matrix to fill with the image direction or nullptr.
+     *
+     */
+    vtkSmartPointer<vtkImageData> imagePreprocessing(const bool useCache = false, vtkMatrix4x4 *direction = nullptr);
+
+    /** \brief Loads the resource with the given name, returns false on error or if aborted.
+     * \param[in] name resource name.
+     *
+     */
+    bool loadResource(const QString &name);
+
+    /** \brief Helper method to load a logo picture and register it as a resource. Returns false on error.
+     * \param[in] name resource name.
+     * \param[in] logo picture file name.
+     *
+     */
+    bool loadLogo(const QString &name, const QString &logo);
+
+    /** \brief Helper method to load a MetaImage and register it as a resource. Returns nullptr on error.
+     * \param[in] name resource name.
+     * \param[in] filename MetaImage header file name.
+     * \param[in] crop true to crop the image to its non-zero voxels and false otherwise.
+     *
+     */
+    vtkSmartPointer<vtkImageData> loadImage(const QString &name, const QString &filename, const bool crop = false);
+
+    /** \brief Helper method to get a MetaImage from the resources registry, loading it if not present. Returns
+     * nullptr on error.
+     * \param[in] name resource name, for errors and logs.
+     * \param[in] filename MetaImage header file name.
+     * \param[in] crop true to crop the image to its non-zero voxels and false otherwise.
+     *
+     */
+    vtkSmartPointer<vtkImageData> sharedImage(const QString &name, const QString &filename, const bool crop);
+
+    /** \brief Helper method to load a mesh, recentered, and register it as a resource. Returns nullptr on error.
+     * \param[in] name resource name.
+     * \param[in] filename VTP mesh file name.
+     *
+     */
+    vtkSmartPointer<vtkPolyData> loadMesh(const QString &name, const QString &filename);
+
+    /** \brief Helper method to open a bricked volume file and create the volumes of its bricks. The voxels are
+     * mapped when rendered. Returns false on error.
+     * \param[in] name resource name.
+     * \param[in] filename bricked volume file name.
+     * \param[in] files files on disk the bricked volume has been written from.
+     *
+     */
+    bool loadBrickedVolume(const QString &name, const QString &filename, const QStringList &files);
+
+    /** \brief Helper method to create the decimated levels of detail of a loaded mesh and register them as
+     * resources named '<name> lod <level>'. Returns false on error.
+     * \param[in] name mesh resource name.
+     * \param[in] filename VTP mesh file name.
+     * \param[in] mesh loaded mesh.
+     *
+     */
+    bool loadMeshLevels(const QString &name, const QString &filename, vtkPolyData *mesh);
+
+    /** \brief Helper method to create the downsampled levels of a volume image and register them as resources
+     * named '<name> <factor>x'. Returns false on error.
+     * \param[in] name volume image resource name.
+     * \param[in] files files the image depends on, the first is the cache source.
+     * \param[in] volume volume using the image.
+     * \param[in] image full resolution image.
+     * \param[in] pooling block reduction, maximum for MIP volumes and average for composite ones.
+     * \param[in] useCache true to use the resources cache, only valid if the image depends only on the first file.
      *
      */
-    void volumeLoaderUCHAR();
-    void volumeLoaderUSHORT();
-    void meshLoader();
-    void imagePreprocessing();
+    bool loadVolumeLevels(const QString &name, const QStringList &files, vtkVolume *volume, vtkImageData *image,
+                          const Pooling pooling, const bool useCache = true);
+
+    /** \brief Returns the given image cropped to its non-zero voxels and logs the savings.
+     * \param[in] name resource name.
+     * \param[in] image image to crop.
+     *
+     */
+    vtkSmartPointer<vtkImageData> cropImage(const QString &name, vtkImageData *image);
+
+    /** \brief Returns the MetaImage header and data files of the given image.
+     * \param[in] filename MetaImage header absolute file name.
+     *
+     */
+    QStringList imageFiles(const QString &filename) const;
+
+    /** \brief Returns true if the given resource must be loaded.
+     * \param[in] name resource name.
+     *
+     */
+    bool isRequested(const QString &name) const
+    { return m_requested.isEmpty() || m_requested.contains(name); }
+
+    /** \brief Registers a loaded resource and the files it depends on.
+     * \param[in] name resource name.
+     * \param[in] data resource data object.
+     * \param[in] files files on disk used to create the resource.
+     *
+     */
+    void addResource(const QString &name, vtkDataObject *data, const QStringList &files);
+
+    /** \brief Adds the progress observer to the given VTK algorithm, the observer reports the progress and
+     * aborts the algorithm execution if the loading has been aborted.
+     * \param[in] algorithm VTK algorithm raw pointer.
+     *
+     */
+    void observe(vtkAlgorithm *algorithm);
+
+    /** \brief Returns a new progress observer command for this loader.
+     *
+     */
+    vtkSmartPointer<vtkCommand> progressObserver();
+
+    /** \brief VTK progress event callback.
+     *
+     */
+    static void onProgressEvent(vtkObject *caller, unsigned long eventId, void *clientData, void *callData);
+
+    /** \brief Emits the progress signal if the value has changed.
+     * \param[in] fraction progress of the resource being loaded in [0,1].
+     *
+     */
+    void reportProgress(const double fraction);
+
+    /** \brief Moves the given mesh points so the scene center is in 0,0,0.
+     * \param[in] mesh mesh to modify.
+     *
+     */
+    void recenter(vtkPolyData *mesh);
 
     QList<vtkSmartPointer<vtkImageData>> m_images;    /** list of vtkImageData.                 */
     QList<vtkSmartPointer<vtkPolyData>>  m_polyDatas; /** list of mesh objects.                 */
     QList<vtkSmartPointer<vtkVolume>>    m_volumes;   /** list of vtkVolume.                    */
-    QList<vtkSmartPointer<vtkActor2D>>   m_logos;     /** list of 2D actors.                    */
     QList<vtkSmartPointer<vtkActor>>     m_actors;    /** list of 3D actors.                    */
     QList<vtkSmartPointer<vtkPlane>>     m_planes;    /** list of planes.                       */
 
-    QString                              m_error;     /** error message or empty if successful. */
-    bool                                 m_abort;     /** true if aborted, false otherwise.     */
+    QMap<QString, vtkSmartPointer<vtkDataObject>>      m_resources;    /** loaded data objects by name.   */
+    QMap<QString, QStringList>                         m_dependencies; /** file to resource names.        */
+    QMap<QString, QList<vtkSmartPointer<vtkPolyData>>> m_meshLevels;   /** mesh levels of detail by name. */
+    QMap<vtkSmartPointer<vtkVolume>, QList<vtkSmartPointer<vtkImageData>>> m_volumeLevels; /** volume resolution levels. */
+    QList<std::shared_ptr<BrickedVolume>>              m_bricked;      /** out-of-core volumes.           */
+    QList<vtkSmartPointer<vtkImageData>>               m_shared;       /** images shared during the run.  */
+    QStringList                                        m_requested;    /** resources to load, empty all. */
+    QStringList                                        m_order;        /** resources load order.          */
+    QStringList                                        m_volumeNames;  /** ray cast volumes to load.      */
+
+    QString                              m_error;         /** error message or empty if successful. */
+    std::atomic<bool>                    m_abort;         /** true if aborted, false otherwise.     */
+    ResourceCache                        m_cache;         /** processed resources cache.            */
+    FusionRule                           m_fusionRule;    /** fusion volume rule.                   */
+    unsigned long long                   m_slabBudget;    /** preprocessing input slab size.        */
+    unsigned long long                   m_brickBudget;   /** out-of-core volumes memory budget.    */
+    bool                                 m_optimizeMeshes; /** true to optimize the loaded meshes.  */
+    bool                                 m_preprocessMCI; /** true to preprocess the MCI image.     */
+    bool                                 m_outOfCore;     /** true to render the brain out-of-core. */
+    int                                  m_progressTotal; /** number of resources to load.          */
+    int                                  m_progressDone;  /** number of resources loaded.           */
+    int                                  m_progress;      /** last progress value signaled.         */
 
 };
 
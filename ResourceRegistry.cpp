@@ -0,0 +1,209 @@
+/*
+ File: ResourceRegistry.cpp
+ Created on: 18/10/2026
+ Author: agent
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Project
+#include "ResourceRegistry.h"
+
+// Qt
+#include <QFileInfo>
+#include <QMutexLocker>
+
+//--------------------------------------------------------------------
+ResourceRegistry &ResourceRegistry::instance()
+{
+  static ResourceRegistry registry;
+
+  return registry;
+}
+
+//--------------------------------------------------------------------
+QString ResourceRegistry::key(const QString &filename, const QString &parameters)
+{
+  QFileInfo info{filename};
+  auto path = info.canonicalFilePath();
+  if(path.isEmpty()) path = info.absoluteFilePath();
+
+  return path + "|" + parameters;
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkDataObject> ResourceRegistry::find(const QString &filename, const QString &parameters)
+{
+  QMutexLocker lock(&m_mutex);
+
+  purge();
+
+  const auto entryKey = key(filename, parameters);
+  if(!m_entries.contains(entryKey)) return nullptr;
+
+  const auto &entry = m_entries[entryKey];
+  auto data = entry.data;
+
+  for(int i = 0; i < entry.files.size(); ++i)
+  {
+    QFileInfo info{entry.files.at(i)};
+    if(!info.exists() || info.size() != entry.sizes.at(i) || info.lastModified() != entry.modified.at(i))
+    {
+      m_entries.remove(entryKey);
+      return nullptr;
+    }
+  }
+
+  return data;
+}
+
+//--------------------------------------------------------------------
+void ResourceRegistry::insert(const QString &filename, const QString &parameters, vtkDataObject *data, const QStringList &files)
+{
+  if(!data) return;
+
+  Entry entry;
+  entry.data = data;
+
+  for(auto file: files.isEmpty() ? QStringList{filename} : files)
+  {
+    QFileInfo info{file};
+    entry.files    << info.absoluteFilePath();
+    entry.sizes    << info.size();
+    entry.modified << info.lastModified();
+  }
+
+  QMutexLocker lock(&m_mutex);
+
+  m_entries.insert(key(filename, parameters), entry);
+}
+
+//--------------------------------------------------------------------
+void ResourceRegistry::setName(const QString &name, vtkDataObject *data)
+{
+  QMutexLocker lock(&m_mutex);
+
+  m_names.insert(name, data);
+  m_pending.removeAll(name);
+  m_wanted.removeAll(name);
+
+  m_condition.wakeAll();
+}
+
+//--------------------------------------------------------------------
+void ResourceRegistry::setPending(const QStringList &names)
+{
+  QMutexLocker lock(&m_mutex);
+
+  for(auto name: names)
+  {
+    m_names.remove(name);
+    if(!m_pending.contains(name)) m_pending << name;
+  }
+}
+
+//--------------------------------------------------------------------
+void ResourceRegistry::clearPending()
+{
+  QMutexLocker lock(&m_mutex);
+
+  m_pending.clear();
+  m_wanted.clear();
+
+  m_condition.wakeAll();
+}
+
+//--------------------------------------------------------------------
+QString ResourceRegistry::wanted(const QStringList &names)
+{
+  QMutexLocker lock(&m_mutex);
+
+  for(auto name: m_wanted)
+  {
+    if(names.contains(name)) return name;
+  }
+
+  return QString();
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkDataObject> ResourceRegistry::waitNamed(const QString &name, const std::atomic<bool> *abort)
+{
+  QMutexLocker lock(&m_mutex);
+
+  while(true)
+  {
+    auto data = m_names.value(name);
+    if(data || !m_pending.contains(name)) return data;
+    if(abort && *abort) return nullptr;
+
+    if(!m_wanted.contains(name)) m_wanted << name;
+
+    // the timeout allows checking the abort flag.
+    m_condition.wait(&m_mutex, 100);
+  }
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkDataObject> ResourceRegistry::requestNamed(const QString &name, bool &pending)
+{
+  QMutexLocker lock(&m_mutex);
+
+  auto data = m_names.value(name);
+
+  pending = !data && m_pending.contains(name);
+  if(pending && !m_wanted.contains(name)) m_wanted << name;
+
+  return data;
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkDataObject> ResourceRegistry::named(const QString &name)
+{
+  QMutexLocker lock(&m_mutex);
+
+  return m_names.value(name);
+}
+
+//--------------------------------------------------------------------
+void ResourceRegistry::release()
+{
+  QMutexLocker lock(&m_mutex);
+
+  purge();
+}
+
+//--------------------------------------------------------------------
+void ResourceRegistry::purge()
+{
+  // data only referenced by the registry can't be referenced again while the mutex is locked.
+  QMap<vtkDataObject *, int> references;
+  for(auto &entry: m_entries) ++references[entry.data.GetPointer()];
+  for(auto &data: m_names) ++references[data.GetPointer()];
+
+  auto unused = [&references](vtkDataObject *data)
+  { return data->GetReferenceCount() <= references.value(data); };
+
+  for(auto it = m_entries.begin(); it != m_entries.end();)
+  {
+    if(unused(it.value().data)) it = m_entries.erase(it);
+    else ++it;
+  }
+
+  for(auto it = m_names.begin(); it != m_names.end();)
+  {
+    if(unused(it.value())) it = m_names.erase(it);
+    else ++it;
+  }
+}
@@ -0,0 +1,235 @@
+/*
+ File: ResourceRegistry.h
+ Created on: 18/10/2026
+ Author: agent
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RESOURCEREGISTRY_H_
+#define RESOURCEREGISTRY_H_
+
+// VTK
+#include <vtkSmartPointer.h>
+#include <vtkDataObject.h>
+
+// Qt
+#include <QDateTime>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QWaitCondition>
+
+// C++
+#include <atomic>
+
+/** \class ResourceRegistry
+ * \brief Process wide registry of the loaded data objects, keyed by the canonical path of the source file and
+ * the parameters used to load it, so each file is read and held in memory once. The registry holds a reference
+ * to the data, so a lookup can never return an object being freed by another thread. Entries expire when the
+ * files they depend on change on disk and are released once the registry holds the only reference to their
+ * data, on each lookup or when release() is called. The data objects can also be looked up by resource name,
+ * waiting for the resources still pending to be loaded. Can be used from any thread.
+ *
+ */
+class ResourceRegistry
+{
+  public:
+    /** \brief Returns the registry instance.
+     *
+     */
+    static ResourceRegistry &instance();
+
+    /** \brief Returns the data object loaded from the given file with the given parameters, or nullptr if not
+     * registered, released or if any of its files has changed.
+     * \param[in] filename source file name.
+     * \param[in] parameters load parameters.
+     *
+     */
+    vtkSmartPointer<vtkDataObject> find(const QString &filename, const QString &parameters);
+
+    /** \brief Returns the data object loaded from the given file with the given parameters, or nullptr if not
+     * registered, released, if any of its files has changed or if it's not of the given type.
+     * \param[in] filename source file name.
+     * \param[in] parameters load parameters.
+     *
+     */
+    template<typename T> vtkSmartPointer<T> find(const QString &filename, const QString &parameters)
+    { return T::SafeDownCast(find(filename, parameters)); }
+
+    /** \brief Registers a data object loaded from the given file with the given parameters, replacing the
+     * previous one, if any.
+     * \param[in] filename source file name.
+     * \param[in] parameters load parameters.
+     * \param[in] data loaded data object.
+     * \param[in] files files the data depends on, the source file if empty.
+     *
+     */
+    void insert(const QString &filename, const QString &parameters, vtkDataObject *data, const QStringList &files = QStringList());
+
+    /** \brief Associates the given resource name to the given data object.
+     * \param[in] name resource name.
+     * \param[in] data data object.
+     *
+     */
+    void setName(const QString &name, vtkDataObject *data);
+
+    /** \brief Returns the data object with the given resource name or nullptr if there isn't one.
+     * \param[in] name resource name.
+     *
+     */
+    vtkSmartPointer<vtkDataObject> named(const QString &name);
+
+    /** \brief Returns the data object with the given resource name or nullptr if there isn't one or is not of
+     * the given type.
+     * \param[in] name resource name.
+     *
+     */
+    template<typename T> vtkSmartPointer<T> named(const QString &name)
+    { return T::SafeDownCast(named(name)); }
+
+    /** \brief Sets the names of the resources a loader is going to load, previous data with those names is
+     * forgotten.
+     * \param[in] names resource names.
+     *
+     */
+    void setPending(const QStringList &names);
+
+    /** \brief Signals that no more resources are going to be loaded, wakes up the waiting threads.
+     *
+     */
+    void clearPending();
+
+    /** \brief Returns the first of the given resource names that some thread is waiting for or an empty string
+     * if none.
+     * \param[in] names resource names.
+     *
+     */
+    QString wanted(const QStringList &names);
+
+    /** \brief Returns the data object with the given resource name, waiting for it to be loaded if it's pending.
+     * Returns nullptr if it's not pending and there isn't one or if aborted.
+     * \param[in] name resource name.
+     * \param[in] abort abort flag or nullptr.
+     *
+     */
+    vtkSmartPointer<vtkDataObject> waitNamed(const QString &name, const std::atomic<bool> *abort = nullptr);
+
+    /** \brief Returns the data object with the given resource name without waiting. If it's pending the loader
+     * is asked to load it next. Returns nullptr if it's pending or if it's not pending and there isn't one.
+     * \param[in] name resource name.
+     * \param[out] pending true if the resource is still pending and false otherwise.
+     *
+     */
+    vtkSmartPointer<vtkDataObject> requestNamed(const QString &name, bool &pending);
+
+    /** \brief Releases the entries and names whose data is only referenced by the registry.
+     *
+     */
+    void release();
+
+  private:
+    /** \brief ResourceRegistry class private constructor.
+     *
+     */
+    ResourceRegistry()
+    {}
+
+    /** \brief Returns the key of the given file and parameters.
+     * \param[in] filename source file name.
+     * \param[in] parameters load parameters.
+     *
+     */
+    static QString key(const QString &filename, const QString &parameters);
+
+    /** \brief Removes the entries and names whose data is only referenced by the registry. Must be called with
+     * the mutex locked.
+     *
+     */
+    void purge();
+
+    /** \brief Registered data object and the state of its files when loaded.
+     *
+     */
+    struct Entry
+    {
+      vtkSmartPointer<vtkDataObject> data;     /** data object.                             */
+      QStringList                    files;    /** canonical names of the files it uses.    */
+      QList<qint64>                  sizes;    /** sizes of the files.                      */
+      QList<QDateTime>               modified; /** modification times of the files.         */
+    };
+
+    QMutex                                        m_mutex;     /** protects the maps.                   */
+    QWaitCondition                                m_condition; /** signals new names.                   */
+    QMap<QString, Entry>                          m_entries;   /** data objects by key.                 */
+    QMap<QString, vtkSmartPointer<vtkDataObject>> m_names;     /** data objects by resource name.       */
+    QStringList                                   m_pending;   /** names of the resources to be loaded. */
+    QStringList                                   m_wanted;    /** pending names some thread waits for. */
+};
+
+/** \class ResourceHandle
+ * \brief Lazy handle of a named resource. The resource is fetched from the registry on first access, if it's
+ * still pending the loader is asked to load it next and the calling thread waits for it.
+ *
+ */
+template<typename T> class ResourceHandle
+{
+  public:
+    /** \brief ResourceHandle class constructor.
+     * \param[in] name resource name.
+     *
+     */
+    explicit ResourceHandle(const QString &name)
+    : m_name{name}
+    {}
+
+    /** \brief Returns the resource name.
+     *
+     */
+    const QString &name() const
+    { return m_name; }
+
+    /** \brief Returns the resource, waiting for it if it's being loaded, or nullptr if not available or aborted.
+     * \param[in] abort abort flag or nullptr.
+     *
+     */
+    vtkSmartPointer<T> get(const std::atomic<bool> *abort = nullptr)
+    {
+      if(!m_data) m_data = T::SafeDownCast(ResourceRegistry::instance().waitNamed(m_name, abort));
+
+      return m_data;
+    }
+
+    /** \brief Returns true if the resource has been fetched or isn't pending, so get() won't wait. If it's
+     * still pending the loader is asked to load it next.
+     *
+     */
+    bool isReady()
+    {
+      if(m_data) return true;
+
+      bool pending = false;
+      m_data = T::SafeDownCast(ResourceRegistry::instance().requestNamed(m_name, pending));
+
+      return m_data || !pending;
+    }
+
+  private:
+    QString            m_name; /** resource name.                           */
+    vtkSmartPointer<T> m_data; /** resource data or nullptr if not fetched. */
+};
+
+#endif // RESOURCEREGISTRY_H_
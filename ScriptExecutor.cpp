@@ -20,14 +20,13 @@
 // Project
 #include <ScriptExecutor.h>
 #include <ResourceLoader.h>
+#include <ResourceRegistry.h>
 #include "Utils.h"
 
-// Qt
-#include <QApplication>
-
 // VTK
 #include <vtkSphereSource.h>
 #include <vtkActor.h>
+#include <vtkLODActor.h>
 #include <vtkActor2D.h>
 #include <vtkVolume.h>
 #include <vtkTransform.h>
@@ -40,6 +39,7 @@
 #include <vtkProperty.h>
 #include <vtkMapper.h>
 #include <vtkImageData.h>
+#include <vtkPolyData.h>
 #include <vtkLookupTable.h>
 #include <vtkImageReslice.h>
 #include <vtkImageMapToColors.h>
@@ -49,6 +49,7 @@
 #include <vtkPNGWriter.h>
 #include <vtkPointData.h>
 #include <vtkImageActor.h>
+#include <vtkImageMapper.h>
 #include <vtkImageMapper3D.h>
 #include <vtkImageProperty.h>
 #include <vtkImageSliceMapper.h>
@@ -76,61 +77,101 @@
 // C++
 #include <cstring> // memcpy
 #include <limits>  // min, max
-#include <chrono>
-#include <thread>
 
 //--------------------------------------------------------------------
-ScriptExecutor::ScriptExecutor(vtkSmartPointer<vtkRenderer> renderer, ResourceLoaderThread *loader, QObject* parent)
-: QThread   {parent}
+ScriptExecutor::ScriptExecutor(vtkSmartPointer<vtkRenderer> renderer)
+: m_abort   {false}
+, m_command {0}
 , m_renderer{renderer}
-, m_abort   {false}
+, m_image   {"brain image"}
+, m_mciImage{"mci image"}
 {
-  getResources(loader);
+  getResources();
 }
 
 //--------------------------------------------------------------------
-void ScriptExecutor::run()
+void ScriptExecutor::restart()
 {
-  if(!m_error.isEmpty()) return;
+  m_abort   = false;
+  m_command = 0;
 
-  fadeIn();
+  // the script starts from the current scene.
+  m_scene       = m_shown;
+  m_scene.frame = 0;
 
-  if(m_abort) return;
-  waitFrames(5);
+  m_commands.clear();
+  if(!m_error.isEmpty()) return;
 
-  if(m_abort) return;
-  reslice();
+  m_commands << fadeIn()
+             << waitFrames(5)
+             << reslice()
+             << waitFrames(5)
+             << fadeOut()
+             << waitFrames(5)
+             << threesixtynoscope()
+             << waitFrames(10);
+}
 
-  if(m_abort) return;
-  waitFrames(5);
+//--------------------------------------------------------------------
+ScriptExecutor::Step ScriptExecutor::nextScene(SceneDescriptor &scene)
+{
+  while(!m_abort && m_command < m_commands.size())
+  {
+    const auto step = m_commands[m_command](m_scene);
 
-  if(m_abort) return;
-  fadeOut();
+    switch(step)
+    {
+      case Step::FINISHED:
+        ++m_command;
+        break;
+      case Step::FRAME:
+        ++m_scene.frame;
+        scene = m_scene;
+        return step;
+      default:
+        return step;
+    }
+  }
 
-  if(m_abort) return;
-  waitFrames(5);
+  // finished!
+  return Step::FINISHED;
+}
 
-  if(m_abort) return;
-  threesixtynoscope();
+//--------------------------------------------------------------------
+QList<QStringList> ScriptExecutor::shotResources()
+{
+  // scene actors and fade in, then reslice. Fade out and rotation use the same actors.
+  return { QStringList{"brain mesh", "mci mesh", "logo 0", "logo 1", "logo 2"},
+           QStringList{"brain image", "mci image"} };
+}
 
-  if(m_abort) return;
-  waitFrames(10);
+//--------------------------------------------------------------------
+QList<vtkSmartPointer<vtkPolyData>> ScriptExecutor::meshLevels(const QString &name)
+{
+  QList<vtkSmartPointer<vtkPolyData>> levels;
 
-  // finished!
+  // registered by the loader from finer to coarser.
+  auto &registry = ResourceRegistry::instance();
+  while(auto level = registry.named<vtkPolyData>(QString("%1 lod %2").arg(name).arg(levels.size() + 1)))
+  {
+    levels << level;
+  }
+
+  return levels;
 }
 
 //--------------------------------------------------------------------
-void ScriptExecutor::getResources(ResourceLoaderThread *loader)
+void ScriptExecutor::getResources()
 {
-  m_image     = loader->images().first();
-  m_mciImage  = loader->images().last();
-  m_brainMesh = loader->polyDatas().first();
-  m_mciMesh   = loader->polyDatas().last();
+  // the loader can be still running, resources are fetched from the registry. The images are fetched when the
+  // reslice shot starts, they can be still loading.
+  auto &registry = ResourceRegistry::instance();
+  m_brainMesh = registry.named<vtkPolyData>("brain mesh");
+  m_mciMesh   = registry.named<vtkPolyData>("mci mesh");
 
-  if(!m_renderer || !m_image || !m_mciImage || !m_brainMesh || !m_mciMesh)
+  if(!m_renderer || !m_brainMesh || !m_mciMesh)
   {
     error("Invalid data.");
-    std::cout << "error in parameters in script executor" << std::endl << std::flush;
     return;
   }
 
@@ -140,7 +181,19 @@ void ScriptExecutor::getResources(ResourceLoaderThread *loader)
   mapper1->SetScalarVisibility(false);
   mapper1->Update();
 
-  m_mciActor = vtkSmartPointer<vtkActor>::New();
+  // the levels of detail are used only if the full mesh can't be rendered in the time allocated by the
+  // interactor, final frames are rendered with the still update rate and always use the full mesh.
+  auto mciActor = vtkSmartPointer<vtkLODActor>::New();
+  for(auto level: meshLevels("mci mesh"))
+  {
+    auto mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+    mapper->SetInputData(level);
+    mapper->SetScalarVisibility(false);
+
+    mciActor->AddLODMapper(mapper);
+  }
+
+  m_mciActor = mciActor;
   m_mciActor->GetProperty()->SetColor(1.,0.,0.);
   m_mciActor->GetProperty()->SetInterpolationToPhong();
   m_mciActor->GetProperty()->SetBackfaceCulling(true);
@@ -168,7 +221,21 @@ void ScriptExecutor::getResources(ResourceLoaderThread *loader)
   mapper2->SetInputConnection(clipper->GetOutputPort());
   mapper2->SetScalarVisibility(false);
 
-  m_brainActor = vtkSmartPointer<vtkActor>::New();
+  auto brainActor = vtkSmartPointer<vtkLODActor>::New();
+  for(auto level: meshLevels("brain mesh"))
+  {
+    auto levelClipper = vtkSmartPointer<vtkClipPolyData>::New();
+    levelClipper->SetInputData(level);
+    levelClipper->SetClipFunction(m_plane);
+
+    auto mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+    mapper->SetInputConnection(levelClipper->GetOutputPort());
+    mapper->SetScalarVisibility(false);
+
+    brainActor->AddLODMapper(mapper);
+  }
+
+  m_brainActor = brainActor;
   m_brainActor->SetMapper(mapper2);
   m_brainActor->GetProperty()->SetColor(0.3, 0.3, 0.3);
   m_brainActor->GetProperty()->SetInterpolationToPhong();
@@ -178,9 +245,25 @@ void ScriptExecutor::getResources(ResourceLoaderThread *loader)
 
   m_renderer->AddActor(m_brainActor);
 
-  for(auto actor: loader->logos())
+  // logos are placed one after the other.
+  int position = 0;
+  for(auto name: {"logo 0", "logo 1", "logo 2"})
   {
-    m_renderer->AddActor(actor);
+    auto image = registry.named<vtkImageData>(name);
+    if(!image) continue;
+
+    auto imageMapper = vtkSmartPointer<vtkImageMapper>::New();
+    imageMapper->SetInputData(image);
+    imageMapper->SetColorWindow(255);
+    imageMapper->SetColorLevel(127.5);
+
+    auto imageActor = vtkSmartPointer<vtkActor2D>::New();
+    imageActor->SetMapper(imageMapper);
+    imageActor->SetPosition(position, 0);
+
+    position += image->GetExtent()[1];
+
+    m_renderer->AddActor(imageActor);
   }
 
   auto windowSize = m_renderer->GetRenderWindow()->GetSize();
@@ -196,105 +279,213 @@ void ScriptExecutor::getResources(ResourceLoaderThread *loader)
   textActor->GetTextProperty()->SetColor(1.0, 1.0, 1.0);
 
   m_renderer->AddActor2D(textActor);
+
+  // SCALAR BAR, shown while slicing.
+  auto barLut = vtkSmartPointer<vtkLookupTable>::New();
+  barLut->SetTableRange(4.7, 6.2);
+  barLut->SetHueRange(0.0, 1.0);
+  barLut->SetSaturationRange(1.0, 1.0);
+  barLut->SetAlphaRange(1.0, 1.0);
+  barLut->SetValueRange(1.0, 1.0);
+  barLut->Build();
+
+  m_scalarBar = vtkSmartPointer<vtkScalarBarActor>::New();
+  m_scalarBar->SetLookupTable(barLut);
+  m_scalarBar->SetTitle("t-values");
+  m_scalarBar->SetTitleRatio(0.9);
+  m_scalarBar->GetTitleTextProperty()->SetFontFamilyToArial();
+  m_scalarBar->GetTitleTextProperty()->SetFontSize(10);
+  m_scalarBar->GetLabelTextProperty()->SetFontFamilyToArial();
+  m_scalarBar->GetLabelTextProperty()->SetColor(1.0, 1.0, 1.0);
+  m_scalarBar->SetNumberOfLabels(4);
+// 4K doesn't scale 2D actors, needs those modifications.
+  m_scalarBar->GetLabelTextProperty()->SetFontSize(58);
+  m_scalarBar->SetMaximumHeightInPixels(1200);
+  m_scalarBar->SetMaximumWidthInPixels(140);
+//  m_scalarBar->SetMaximumHeightInPixels(400);
+//  m_scalarBar->SetMaximumWidthInPixels(60);
+  m_scalarBar->SetAnnotationTextScaling(true);
+//  m_scalarBar->SetDisplayPosition(windowSize[0]-100, windowSize[1]/2 - 200);
+  m_scalarBar->SetDisplayPosition(3840-275, 480);
+  m_scalarBar->Modified();
 }
 
 //--------------------------------------------------------------------
-void ScriptExecutor::waitForFrameToRender()
+ScriptExecutor::Command ScriptExecutor::waitFrames(const unsigned int numFrames)
 {
-  QApplication::processEvents();
+  unsigned int frame = 0;
 
-  if(!m_abort)
+  return [frame, numFrames](SceneDescriptor &) mutable
   {
-    // really, this is needed to allow the vtk pipelines to finish before the main thread executes a
-    // render in the main thread. Thinking on moving the execution thread to the same thread of the
-    // application and remove this.
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    return (frame++ < numFrames) ? Step::FRAME : Step::FINISHED;
+  };
+}
+
+//--------------------------------------------------------------------
+ScriptExecutor::Command ScriptExecutor::threesixtynoscope()
+{
+  const double rad = 0.25;
+  double i = 0;
 
-    emit render();
+  return [i, rad](SceneDescriptor &scene) mutable
+  {
+    if(i >= 360.0) return Step::FINISHED;
 
-    m_mutex.lock();
-    m_waitCondition.wait(&m_mutex);
-    m_mutex.unlock();
-  }
+    scene.rotation += rad;
+    i += rad;
+
+    return Step::FRAME;
+  };
 }
 
 //--------------------------------------------------------------------
-void ScriptExecutor::waitFrames(const unsigned int numFrames)
+ScriptExecutor::Command ScriptExecutor::reslice()
 {
-  for (unsigned int i = 0; i < numFrames; ++i)
+  enum class Stage: char { IMAGES, DOWN, STILL, UP, DONE };
+
+  const auto step         = 217.6/400.;
+  const auto initialPoint = 108.8 - (20 * step);
+  const auto finalPoint   = -108.8 + (20 * step);
+
+  auto stage        = Stage::IMAGES;
+  auto reslicePoint = initialPoint;
+  int  still        = 15;
+
+  return [this, stage, step, initialPoint, finalPoint, reslicePoint, still](SceneDescriptor &scene) mutable
   {
-    if(m_abort) return;
-    waitForFrameToRender();
-  }
+    switch(stage)
+    {
+      case Stage::IMAGES:
+        scene.showBar = true;
+
+        // the images can be still loading, the render thread doesn't wait for them.
+        if(!m_image.isReady() || !m_mciImage.isReady()) return Step::WAIT;
+
+        if(!m_image.get() || !m_mciImage.get())
+        {
+          error("Invalid data.");
+          stage = Stage::DONE;
+          return Step::FINISHED;
+        }
+
+        scene.showSlice = true;
+        stage = Stage::DOWN;
+        /* fall through */
+      case Stage::DOWN:
+        if(reslicePoint > finalPoint)
+        {
+          scene.slice      = reslicePoint;
+          scene.clipOrigin = reslicePoint;
+          reslicePoint    -= step;
+
+          return Step::FRAME;
+        }
+
+        stage = Stage::STILL;
+        /* fall through */
+      case Stage::STILL:
+        if(still-- > 0) return Step::FRAME;
+
+        stage = Stage::UP;
+        /* fall through */
+      case Stage::UP:
+        if(reslicePoint < initialPoint)
+        {
+          scene.slice      = reslicePoint;
+          scene.clipOrigin = reslicePoint;
+          reslicePoint    += step;
+
+          return Step::FRAME;
+        }
+
+        scene.showBar = false;
+        stage = Stage::DONE;
+        /* fall through */
+      default:
+        return Step::FINISHED;
+    }
+  };
 }
 
 //--------------------------------------------------------------------
-void ScriptExecutor::threesixtynoscope()
+void ScriptExecutor::apply(const SceneDescriptor &scene)
 {
-  double rad = 0.25;
-  for(double i = 0; i < 360.0; i += rad)
+  if(scene.rotation != m_shown.rotation)
   {
-    if(m_abort) return;
+    m_brainActor->SetOrientation(0, 0, scene.rotation);
+    m_mciActor->SetOrientation(0, 0, scene.rotation);
+
+    for(auto volume: m_volumes) volume->SetOrientation(0, 0, scene.rotation);
+  }
 
-    m_brainActor->RotateWXYZ(rad, 0, 0, 1);
-    m_mciActor->RotateWXYZ(rad, 0, 0, 1);
+  m_brainActor->GetProperty()->SetOpacity(scene.brainOpacity);
+  m_mciActor->GetProperty()->SetOpacity(scene.mciOpacity);
 
-    waitForFrameToRender();
+  if(scene.clipOrigin != m_shown.clipOrigin) m_plane->SetOrigin(0., scene.clipOrigin, 0.);
+
+  if(scene.showSlice && !m_sliceActor)
+  {
+    if(!createSlice()) return;
+    updateSlice(scene.slice);
+  }
+  else if(scene.showSlice && scene.slice != m_shown.slice)
+  {
+    updateSlice(scene.slice);
   }
+
+  if(m_sliceActor) m_sliceActor->SetVisibility(scene.showSlice);
+
+  if(scene.showBar != m_shown.showBar)
+  {
+    if(scene.showBar) m_renderer->AddActor(m_scalarBar);
+    else              m_renderer->RemoveActor(m_scalarBar);
+  }
+
+  m_shown = scene;
 }
 
 //--------------------------------------------------------------------
-void ScriptExecutor::reslice()
+void ScriptExecutor::addVolumes(const QList<vtkSmartPointer<vtkVolume>> &volumes)
 {
-  const QString shotPath{"D:\\Descargas\\test\\"};
+  for(auto volume: volumes)
+  {
+    if(m_volumes.contains(volume)) continue;
 
-  // SCALAR BAR
-  auto barLut = vtkSmartPointer<vtkLookupTable>::New();
-  barLut->SetTableRange(4.7, 6.2);
-  barLut->SetHueRange(0.0, 1.0);
-  barLut->SetSaturationRange(1.0, 1.0);
-  barLut->SetAlphaRange(1.0, 1.0);
-  barLut->SetValueRange(1.0, 1.0);
-  barLut->Build();
+    // the volumes can be added after the script has rotated the meshes.
+    volume->SetOrientation(0, 0, m_shown.rotation);
 
-  auto scalarBar = vtkSmartPointer<vtkScalarBarActor>::New();
-  scalarBar->SetLookupTable(barLut);
-  scalarBar->SetTitle("t-values");
-  scalarBar->SetTitleRatio(0.9);
-  scalarBar->GetTitleTextProperty()->SetFontFamilyToArial();
-  scalarBar->GetTitleTextProperty()->SetFontSize(10);
-  scalarBar->GetLabelTextProperty()->SetFontFamilyToArial();
-  scalarBar->GetLabelTextProperty()->SetColor(1.0, 1.0, 1.0);
-  scalarBar->SetNumberOfLabels(4);
-// 4K doesn't scale 2D actors, needs those modifications.
-  scalarBar->GetLabelTextProperty()->SetFontSize(58);
-  scalarBar->SetMaximumHeightInPixels(1200);
-  scalarBar->SetMaximumWidthInPixels(140);
-//  scalarBar->SetMaximumHeightInPixels(400);
-//  scalarBar->SetMaximumWidthInPixels(60);
-  scalarBar->SetAnnotationTextScaling(true);
+    if(!m_renderer->HasViewProp(volume)) m_renderer->AddVolume(volume);
 
-  auto windowSize = m_renderer->GetRenderWindow()->GetSize();
-//  scalarBar->SetDisplayPosition(windowSize[0]-100, windowSize[1]/2 - 200);
-  scalarBar->SetDisplayPosition(3840-275, 480);
-  scalarBar->Modified();
+    m_volumes << volume;
+  }
+}
 
-  m_renderer->AddActor(scalarBar);
+//--------------------------------------------------------------------
+bool ScriptExecutor::createSlice()
+{
+  // ready, the reslice command waits for them before showing the slice.
+  auto image    = m_image.get();
+  auto mciImage = m_mciImage.get();
+  if(!image || !mciImage)
+  {
+    error("Invalid data.");
+    return false;
+  }
 
   int extent[6];
-  m_image->GetExtent(extent);
+  image->GetExtent(extent);
 
   const double coronal[16] = { 1, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 1 };
 
-  auto matrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  matrix->DeepCopy(coronal);
+  m_sliceMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  m_sliceMatrix->DeepCopy(coronal);
 
   // reslice pipeline to generate the brain texture.
   auto reslice = vtkSmartPointer<vtkImageReslice>::New();
-  reslice->SetInputData(m_image);
+  reslice->SetInputData(image);
   reslice->SetOutputDimensionality(2);
   reslice->SetNumberOfThreads(1);
-  reslice->SetResliceAxes(matrix);
+  reslice->SetResliceAxes(m_sliceMatrix);
   reslice->SetInterpolationModeToCubic();
   reslice->SetOutputExtent(extent[0], extent[1], extent[4], extent[5], 0, 0);
 
@@ -310,18 +501,18 @@ void ScriptExecutor::reslice()
   brainLookupTable->SetNumberOfTableValues(256);
   brainLookupTable->Build();
 
-  auto resliceMapper = vtkSmartPointer<vtkImageMapToColors>::New();
-  resliceMapper->SetLookupTable(brainLookupTable);
-  resliceMapper->SetNumberOfThreads(1);
-  resliceMapper->SetOutputFormatToRGBA();
-  resliceMapper->SetInputConnection(reslice->GetOutputPort());
+  m_sliceColors = vtkSmartPointer<vtkImageMapToColors>::New();
+  m_sliceColors->SetLookupTable(brainLookupTable);
+  m_sliceColors->SetNumberOfThreads(1);
+  m_sliceColors->SetOutputFormatToRGBA();
+  m_sliceColors->SetInputConnection(reslice->GetOutputPort());
 
   // other data: MCI
   auto resliceMCI = vtkSmartPointer<vtkImageReslice>::New();
-  resliceMCI->SetInputData(m_mciImage);
+  resliceMCI->SetInputData(mciImage);
   resliceMCI->SetOutputDimensionality(2);
   resliceMCI->SetNumberOfThreads(1);
-  resliceMCI->SetResliceAxes(matrix);
+  resliceMCI->SetResliceAxes(m_sliceMatrix);
   resliceMCI->SetInterpolationModeToCubic();
   resliceMCI->SetOutputExtent(extent[0], extent[1], extent[4], extent[5], 0, 0);
 
@@ -340,206 +531,163 @@ void ScriptExecutor::reslice()
   rgba[3] = 0.; // Make the first complete transparent.
   MCILookupTable->SetTableValue(0, 0,0,0);
 
-  auto resliceMapperMCI = vtkSmartPointer<vtkImageMapToColors>::New();
-  resliceMapperMCI->SetLookupTable(MCILookupTable);
-  resliceMapperMCI->SetNumberOfThreads(1);
-  resliceMapperMCI->SetOutputFormatToRGBA();
-  resliceMapperMCI->SetInputConnection(resliceMCI->GetOutputPort());
-
-  auto blend = vtkSmartPointer<vtkImageBlend>::New();
-  blend->AddInputData(resliceMapper->GetOutput());
-  blend->AddInputData(resliceMapperMCI->GetOutput());
-  blend->SetOpacity(0, 0.7);
-  blend->SetOpacity(1, 0.3);
-  blend->SetBlendModeToNormal();
-  blend->SetNumberOfThreads(1);
-  blend->DebugOn();
-  blend->GlobalWarningDisplayOn();
+  m_sliceMCIColors = vtkSmartPointer<vtkImageMapToColors>::New();
+  m_sliceMCIColors->SetLookupTable(MCILookupTable);
+  m_sliceMCIColors->SetNumberOfThreads(1);
+  m_sliceMCIColors->SetOutputFormatToRGBA();
+  m_sliceMCIColors->SetInputConnection(resliceMCI->GetOutputPort());
+
+  m_sliceBlend = vtkSmartPointer<vtkImageBlend>::New();
+  m_sliceBlend->AddInputData(m_sliceColors->GetOutput());
+  m_sliceBlend->AddInputData(m_sliceMCIColors->GetOutput());
+  m_sliceBlend->SetOpacity(0, 0.7);
+  m_sliceBlend->SetOpacity(1, 0.3);
+  m_sliceBlend->SetBlendModeToNormal();
+  m_sliceBlend->SetNumberOfThreads(1);
+  m_sliceBlend->DebugOn();
+  m_sliceBlend->GlobalWarningDisplayOn();
 
   // texture of the slice actor.
-  auto texture = vtkSmartPointer<vtkTexture>::New();
-  texture->SetInputConnection(blend->GetOutputPort());
-  texture->InterpolateOn();
-  texture->DebugOn();
-  texture->GlobalWarningDisplayOn();
+  m_sliceTexture = vtkSmartPointer<vtkTexture>::New();
+  m_sliceTexture->SetInputConnection(m_sliceBlend->GetOutputPort());
+  m_sliceTexture->InterpolateOn();
+  m_sliceTexture->DebugOn();
+  m_sliceTexture->GlobalWarningDisplayOn();
 
-  auto plane = vtkPlane::New();
-  plane->SetOrigin(0, 108.8,0);
-  plane->SetNormal(0.,-1.,0.);
+  m_slicePlane = vtkSmartPointer<vtkPlane>::New();
+  m_slicePlane->SetOrigin(0, 108.8,0);
+  m_slicePlane->SetNormal(0.,-1.,0.);
 
-  auto cutter = vtkSmartPointer<vtkCutter>::New();
-  cutter->SetInputData(m_brainMesh);
-  cutter->SetCutFunction(plane);
-  cutter->Update();
+  m_sliceCutter = vtkSmartPointer<vtkCutter>::New();
+  m_sliceCutter->SetInputData(m_brainMesh);
+  m_sliceCutter->SetCutFunction(m_slicePlane);
+  m_sliceCutter->Update();
 
   // triangulator fills the contour creating a polygon that can be textured.
-  auto triangulator = vtkSmartPointer<vtkContourTriangulator>::New();
-  triangulator->SetInputConnection(cutter->GetOutputPort());
+  m_sliceTriangulator = vtkSmartPointer<vtkContourTriangulator>::New();
+  m_sliceTriangulator->SetInputConnection(m_sliceCutter->GetOutputPort());
 
-  auto cutterMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
-  cutterMapper->SetInputData(triangulator->GetOutput());
+  m_sliceMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+  m_sliceMapper->SetInputData(m_sliceTriangulator->GetOutput());
 
   // final textured actor.
-  auto surfaceActor = vtkSmartPointer<vtkActor>::New();
-  surfaceActor->SetMapper(cutterMapper);
-  surfaceActor->SetTexture(texture);
-
-  m_renderer->AddActor(surfaceActor);
-
-  auto step = 217.6/400.;
-  const auto initialPoint = 108.8 - (20 * step);
-  const auto finalPoint   = -108.8 + (20 * step);
-  auto reslicePoint = initialPoint;
-
-  auto length = 181.6; // the same for length in X and Z axis.
-
-  const QString brainSlice = "D:/Descargas/Render/slices/%1-brainSlice.png";
-  const QString mciSlice   = "D:/Descargas/Render/slices/%1-mciSlice.png";
-  const QString blendSlice = "D:/Descargas/Render/slices/%1-blendSlice.png";
-
-  while(reslicePoint > finalPoint)
-  {
-    matrix->SetElement(1, 3, reslicePoint + 108.8); // images have not been translated after loading.
-    matrix->Modified();
-
-    resliceMapper->Update();
-    resliceMapperMCI->Update();
-    blend->Update();
-
-    plane->SetOrigin(0, reslicePoint, 0.);
-    plane->Modified();
+  m_sliceActor = vtkSmartPointer<vtkActor>::New();
+  m_sliceActor->SetMapper(m_sliceMapper);
+  m_sliceActor->SetTexture(m_sliceTexture);
 
-    cutter->Update();
+  m_renderer->AddActor(m_sliceActor);
 
-    triangulator->Update();
-
-    auto data = triangulator->GetOutput();
-    auto array = vtkSmartPointer<vtkFloatArray>::New();
-    array->SetNumberOfComponents(2);
-    array->SetNumberOfTuples(data->GetNumberOfPoints());
-    array->SetName("TextureCoordinates");
-    array->Allocate(data->GetNumberOfPoints());
+  return true;
+}
 
-    for(int i = 0; i < data->GetNumberOfPoints(); ++i)
-    {
-      double coords[3];
-      data->GetPoint(i, coords);
-      array->SetTuple2(i, (coords[0]+90.8)/length, (coords[2]+90.8)/length);
-    }
+//--------------------------------------------------------------------
+void ScriptExecutor::updateSlice(const double position)
+{
+  const auto length = 181.6; // the same for length in X and Z axis.
 
-    triangulator->GetOutput()->GetPointData()->SetTCoords(array);
+  m_sliceMatrix->SetElement(1, 3, position + 108.8); // images have not been translated after loading.
+  m_sliceMatrix->Modified();
 
-    texture->Update();
+  m_sliceColors->Update();
+  m_sliceMCIColors->Update();
+  m_sliceBlend->Update();
 
-    cutterMapper->SetInputData(triangulator->GetOutput());
-    cutterMapper->Update();
-    surfaceActor->Modified();
+  m_slicePlane->SetOrigin(0, position, 0.);
+  m_slicePlane->Modified();
 
-    m_plane->SetOrigin(0., reslicePoint, 0.);
+  m_sliceCutter->Update();
+  m_sliceTriangulator->Update();
 
-    waitForFrameToRender();
-    if(m_abort) return;
+  auto data = m_sliceTriangulator->GetOutput();
+  auto array = vtkSmartPointer<vtkFloatArray>::New();
+  array->SetNumberOfComponents(2);
+  array->SetNumberOfTuples(data->GetNumberOfPoints());
+  array->SetName("TextureCoordinates");
+  array->Allocate(data->GetNumberOfPoints());
 
-    reslicePoint -= step;
+  for(int i = 0; i < data->GetNumberOfPoints(); ++i)
+  {
+    double coords[3];
+    data->GetPoint(i, coords);
+    array->SetTuple2(i, (coords[0]+90.8)/length, (coords[2]+90.8)/length);
   }
 
-  waitFrames(15);
-
-  while(reslicePoint < initialPoint)
-  {
-    matrix->SetElement(1, 3, reslicePoint + 108.8); // images have not been translated after loading.
-    matrix->Modified();
+  data->GetPointData()->SetTCoords(array);
 
-    resliceMapper->Update();
-    resliceMapperMCI->Update();
-    blend->Update();
+  m_sliceTexture->Update();
 
-    plane->SetOrigin(0, reslicePoint, 0.);
-    plane->Modified();
+  m_sliceMapper->SetInputData(data);
+  m_sliceMapper->Update();
+  m_sliceActor->Modified();
+}
 
-    triangulator->Update();
+//--------------------------------------------------------------------
+ScriptExecutor::Command ScriptExecutor::fadeIn()
+{
+  bool started = false, finished = false;
+  int  i = 40, mciOpacity = 0, brainOpacity = 0;
 
-    auto data = triangulator->GetOutput();
-    auto array = vtkSmartPointer<vtkFloatArray>::New();
-    array->SetNumberOfComponents(2);
-    array->SetNumberOfTuples(data->GetNumberOfPoints());
-    array->SetName("TextureCoordinates");
-    array->Allocate(data->GetNumberOfPoints());
+  return [started, finished, i, mciOpacity, brainOpacity](SceneDescriptor &scene) mutable
+  {
+    if(finished) return Step::FINISHED;
 
-    for(int i = 0; i < data->GetNumberOfPoints(); ++i)
+    if(!started)
     {
-      double coords[3];
-      data->GetPoint(i, coords);
-      array->SetTuple2(i, (coords[0]+90.8)/length, (coords[2]+90.8)/length);
+      mciOpacity   = scene.mciOpacity * 100;
+      brainOpacity = scene.brainOpacity * 100;
+      started      = true;
     }
 
-    triangulator->GetOutput()->GetPointData()->SetTCoords(array);
-
-    texture->Update();
-
-    cutterMapper->SetInputData(triangulator->GetOutput());
-    cutterMapper->Update();
-    surfaceActor->Modified();
-
-    m_plane->SetOrigin(0., reslicePoint, 0.);
+    if(brainOpacity <= 100 && mciOpacity >= 0 && i <= 100)
+    {
+      brainOpacity += 2;
+      mciOpacity -= 2;
+      scene.mciOpacity = mciOpacity/100.;
+      scene.brainOpacity = brainOpacity/100.;
+      i += 2;
 
-    waitForFrameToRender();
-    if(m_abort) return;
+      return Step::FRAME;
+    }
 
-    reslicePoint += step;
-  }
+    scene.mciOpacity = 0;
+    scene.brainOpacity = 1;
+    finished = true;
 
-  m_renderer->RemoveActor(scalarBar);
+    return Step::FRAME;
+  };
 }
 
 //--------------------------------------------------------------------
-void ScriptExecutor::fadeIn()
+ScriptExecutor::Command ScriptExecutor::fadeOut()
 {
-  int mciOpacity = m_mciActor->GetProperty()->GetOpacity() * 100;
-  int brainOpacity = m_brainActor->GetProperty()->GetOpacity() * 100;
+  bool started = false, finished = false;
+  int  mciOpacity = 0, brainOpacity = 0;
 
-  for(int i = 40; brainOpacity <= 100 && mciOpacity >= 0 && i <= 100; i+=2)
+  return [started, finished, mciOpacity, brainOpacity](SceneDescriptor &scene) mutable
   {
-    brainOpacity += 2;
-    mciOpacity -= 2;
-    m_mciActor->GetProperty()->SetOpacity(mciOpacity/100.);
-    m_mciActor->GetProperty()->Modified();
-    m_mciActor->Modified();
-    m_brainActor->GetProperty()->SetOpacity(brainOpacity/100.);
-    m_brainActor->GetProperty()->Modified();
-    m_brainActor->Modified();
-
-    waitForFrameToRender();
-  }
+    if(finished) return Step::FINISHED;
 
-  m_mciActor->GetProperty()->SetOpacity(0);
-  m_brainActor->GetProperty()->SetOpacity(1);
-
-  waitForFrameToRender();
-}
+    if(!started)
+    {
+      mciOpacity   = scene.mciOpacity * 100;
+      brainOpacity = scene.brainOpacity * 100;
+      started      = true;
+    }
 
-//--------------------------------------------------------------------
-void ScriptExecutor::fadeOut()
-{
-  int mciOpacity = m_mciActor->GetProperty()->GetOpacity() * 100;
-  int brainOpacity = m_brainActor->GetProperty()->GetOpacity() * 100;
+    if(brainOpacity >= 40 && mciOpacity <= 60)
+    {
+      brainOpacity -= 2;
+      mciOpacity += 2;
+      scene.mciOpacity = mciOpacity/100.;
+      scene.brainOpacity = brainOpacity/100.;
 
-  for(int i = 0; brainOpacity >= 40 && mciOpacity <= 60; i+=2)
-  {
-    brainOpacity -= 2;
-    mciOpacity += 2;
-    m_mciActor->GetProperty()->SetOpacity(mciOpacity/100.);
-    m_mciActor->GetProperty()->Modified();
-    m_mciActor->Modified();
-    m_brainActor->GetProperty()->SetOpacity(brainOpacity/100.);
-    m_brainActor->GetProperty()->Modified();
-    m_brainActor->Modified();
-
-    waitForFrameToRender();
-  }
+      return Step::FRAME;
+    }
 
-  m_mciActor->GetProperty()->SetOpacity(0.6);
-  m_brainActor->GetProperty()->SetOpacity(0.4);
+    scene.mciOpacity = 0.6;
+    scene.brainOpacity = 0.4;
+    finished = true;
 
-  waitForFrameToRender();
+    return Step::FRAME;
+  };
 }
@@ -20,14 +20,17 @@
 #ifndef SCRIPTEXECUTOR_H_
 #define SCRIPTEXECUTOR_H_
 
-#include <QThread>
+#include "ResourceRegistry.h"
 
 #include <vtkSmartPointer.h>
 #include <vtkActor.h>
+#include <vtkImageData.h>
 
 #include <QList>
-#include <QMutex>
-#include <QWaitCondition>
+#include <QString>
+#include <QStringList>
+
+#include <functional>
 
 class vtkRenderer;
 class vtkActor;
@@ -35,31 +38,60 @@ class vtkVolume;
 class vtkPlane;
 class vtkImageData;
 class vtkPolyData;
-
-class ResourceLoaderThread;
+class vtkMatrix4x4;
+class vtkImageMapToColors;
+class vtkImageBlend;
+class vtkTexture;
+class vtkCutter;
+class vtkContourTriangulator;
+class vtkPolyDataMapper;
+class vtkScalarBarActor;
+
+/** \brief State of the scene in a frame of the script.
+ *
+ */
+struct SceneDescriptor
+{
+  unsigned long long frame        = 0;     /** frame number.                                   */
+  double             rotation     = 0;     /** rotation of the meshes around z, in degrees.    */
+  double             brainOpacity = 0.4;   /** opacity of the brain mesh.                      */
+  double             mciOpacity   = 0.6;   /** opacity of the MCI mesh.                        */
+  double             clipOrigin   = 108.8; /** y coordinate of the brain mesh clipping plane.  */
+  double             slice        = 108.8; /** y coordinate of the coronal slice.              */
+  bool               showSlice    = false; /** true to show the coronal slice.                 */
+  bool               showBar      = false; /** true to show the scalar bar.                    */
+};
 
 /** \class ScriptExecutor
- * \brief Modifies the scene and creates actors if needed for the frame. Signals for a frame creation once finished modifying the scene.
+ * \brief Runs the script on the render thread one frame at a time. The script commands are state machines
+ * that modify the state of the scene and yield once per frame, the renderer asks for the state of the next
+ * frame and applies it to the scene before rendering.
  * This file needs to be modified as the script is pure C++.
  *
  */
 class ScriptExecutor
-: public QThread
 {
-    Q_OBJECT
   public:
+    /** \brief Result of advancing the script.
+     *
+     */
+    enum class Step: char
+    {
+      FRAME    = 0, /** the scene state of a new frame is ready.                 */
+      WAIT     = 1, /** waiting for a resource, no frame yet, must be retried.   */
+      FINISHED = 2, /** the script or command has finished, no frame.           */
+    };
+
     /** \brief ScriptExecutor class constructor.
      * \param[in] renderer scene vtk renderer.
-     * \param[in] loader resource loader thread.
-     * \param[in] parent raw pointer of the QObject owner of this one.
      *
      */
-    explicit ScriptExecutor(vtkSmartPointer<vtkRenderer> renderer, ResourceLoaderThread* loader, QObject *parent = nullptr);
+    explicit ScriptExecutor(vtkSmartPointer<vtkRenderer> renderer);
 
-    /** \brief ScriptExecutor class virtual destructor.
+    /** \brief ScriptExecutor class destructor.
      *
      */
-    virtual ~ScriptExecutor()
+    ~ScriptExecutor()
     {}
 
     /** \brief Returns the error string.
@@ -68,41 +100,76 @@ class ScriptExecutor
     const QString getError() const
     { return m_error; }
 
+    /** \brief Returns the names of the resources used by each shot of the script, in shot order. The resources
+     * of the first shot must be loaded before creating the executor, the rest are fetched when used.
+     *
+     */
+    static QList<QStringList> shotResources();
+
     /** \brief Signals the need to abort the script.
      *
      */
     void abort()
     { m_abort = true; }
 
-    /** \brief Wakes up the executor to create the next frame.
+    /** \brief Returns true if the script has been aborted.
      *
      */
-    void nextFrame()
-    { m_waitCondition.wakeOne(); }
+    bool isAborted() const
+    { return m_abort; }
 
-    /** \brief Resets the initial data.
+    /** \brief Returns true if the script has finished or has been aborted, or if it has never been started.
      *
      */
-    void restart()
-    { m_abort = false; }
+    bool isFinished() const
+    { return m_abort || m_command >= m_commands.size(); }
 
-  signals:
-    void render();
+    /** \brief Resets the script to its first frame, starting from the current scene.
+     *
+     */
+    void restart();
 
-  protected:
-    virtual void run();
+    /** \brief Advances the script to its next frame.
+     * \param[out] scene scene state of the frame, only modified if a frame is returned.
+     *
+     */
+    Step nextScene(SceneDescriptor &scene);
+
+    /** \brief Applies the given scene state to the scene.
+     * \param[in] scene scene state.
+     *
+     */
+    void apply(const SceneDescriptor &scene);
+
+    /** \brief Adds the given ray cast volumes to the scene, they are rotated with the meshes.
+     * \param[in] volumes volumes recentered by the loader.
+     *
+     */
+    void addVolumes(const QList<vtkSmartPointer<vtkVolume>> &volumes);
 
   private:
+    /** \brief Script command, modifies the given scene state and yields a frame or finishes.
+     *
+     */
+    using Command = std::function<Step(SceneDescriptor &)>;
+
     /** \brief Helper method to render a given number of still frames.
      * \param[in] numFrames number of still frames to render.
      *
      */
-    void waitFrames(const unsigned int numFrames);
+    Command waitFrames(const unsigned int numFrames);
+
+    /** \brief Helper method to get the resources from the resources registry and create the scene actors.
+     *
+     */
+    void getResources();
 
-    /** \brief Helper method to get the resources from the resource loader thread.
+    /** \brief Returns the levels of detail of the given mesh resource from the resources registry, from finer
+     * to coarser.
+     * \param[in] name mesh resource name.
      *
      */
-    void getResources(ResourceLoaderThread *loader);
+    static QList<vtkSmartPointer<vtkPolyData>> meshLevels(const QString &name);
 
     /** \brief Modifies the error string.
      * \param[in] message error message.
@@ -111,21 +178,29 @@ class ScriptExecutor
     void error(const QString &message)
     { m_error = message; }
 
-    /** \brief Signals the need to save the current frame and stops the execution until 'nextFrame()' method is called by the main application.
+    /** \brief Creates the coronal slice pipeline and actor. Returns true on success and false otherwise.
+     *
+     */
+    bool createSlice();
+
+    /** \brief Moves the coronal slice to the given position.
+     * \param[in] position y coordinate of the slice.
      *
      */
-    void waitForFrameToRender();
+    void updateSlice(const double position);
 
-    QString        m_error;         /** error mesasge or empty if everything is good.   */
-    bool           m_abort;         /** true to abort the current render.               */
-    QMutex         m_mutex;         /** mutex for the wait condition.                   */
-    QWaitCondition m_waitCondition; /** wait condition for waiting for the main thread. */
+    QString           m_error;    /** error mesasge or empty if everything is good. */
+    bool              m_abort;    /** true to abort the current render.             */
+    QList<Command>    m_commands; /** script commands in order.                     */
+    int               m_command;  /** index of the running command.                 */
+    SceneDescriptor   m_scene;    /** scene state being modified by the script.     */
+    SceneDescriptor   m_shown;    /** scene state applied to the scene.             */
 
     // script commands
-    void threesixtynoscope(); // never got to make one in Counter Strike...
-    void reslice();
-    void fadeIn();
-    void fadeOut();
+    Command threesixtynoscope(); // never got to make one in Counter Strike...
+    Command reslice();
+    Command fadeIn();
+    Command fadeOut();
 
     friend class MovieRenderer;
 
@@ -133,12 +208,26 @@ class ScriptExecutor
 
     // data for the script, depends on the scene.
     vtkSmartPointer<vtkPlane>     m_plane;
-    vtkSmartPointer<vtkImageData> m_image;
-    vtkSmartPointer<vtkImageData> m_mciImage;
+    ResourceHandle<vtkImageData>  m_image;
+    ResourceHandle<vtkImageData>  m_mciImage;
     vtkSmartPointer<vtkPolyData>  m_brainMesh;
     vtkSmartPointer<vtkPolyData>  m_mciMesh;
     vtkSmartPointer<vtkActor>     m_brainActor;
     vtkSmartPointer<vtkActor>     m_mciActor;
+    QList<vtkSmartPointer<vtkVolume>> m_volumes;
+
+    // coronal slice, created when first shown.
+    vtkSmartPointer<vtkScalarBarActor>      m_scalarBar;
+    vtkSmartPointer<vtkMatrix4x4>           m_sliceMatrix;
+    vtkSmartPointer<vtkImageMapToColors>    m_sliceColors;
+    vtkSmartPointer<vtkImageMapToColors>    m_sliceMCIColors;
+    vtkSmartPointer<vtkImageBlend>          m_sliceBlend;
+    vtkSmartPointer<vtkTexture>             m_sliceTexture;
+    vtkSmartPointer<vtkPlane>               m_slicePlane;
+    vtkSmartPointer<vtkCutter>              m_sliceCutter;
+    vtkSmartPointer<vtkContourTriangulator> m_sliceTriangulator;
+    vtkSmartPointer<vtkPolyDataMapper>      m_sliceMapper;
+    vtkSmartPointer<vtkActor>               m_sliceActor;
 };
 
 #endif // SCRIPTEXECUTOR_H_
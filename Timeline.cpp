@@ -0,0 +1,202 @@
+/*
+ File: Timeline.cpp
+ Created on: 18/10/2026
+ Author: agent
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Project
+#include "Timeline.h"
+
+// VTK
+#include <vtkActor.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkProp3D.h>
+#include <vtkProperty.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+  /** \brief Interpolates the given affine matrices, the rotation as a quaternion and the scale and translation
+   *         linearly.
+   * \param[in] from matrix at 0.
+   * \param[in] to matrix at 1.
+   * \param[in] t interpolation position.
+   * \param[out] result interpolated matrix.
+   *
+   */
+  void interpolate(const double from[16], const double to[16], const double t, double result[16])
+  {
+    double rotations[2][4], scales[2][3];
+
+    const double *matrices[2]{from, to};
+    for(int m: {0,1})
+    {
+      double rotation[3][3];
+      for(int j = 0; j < 3; ++j)
+      {
+        scales[m][j] = std::sqrt(matrices[m][j] * matrices[m][j] + matrices[m][4+j] * matrices[m][4+j] + matrices[m][8+j] * matrices[m][8+j]);
+        for(int i = 0; i < 3; ++i) rotation[i][j] = matrices[m][4*i+j] / std::max(scales[m][j], 1e-12);
+      }
+
+      vtkMath::Matrix3x3ToQuaternion(rotation, rotations[m]);
+    }
+
+    // shortest arc.
+    auto dot = vtkMath::Dot(rotations[0] + 1, rotations[1] + 1) + rotations[0][0] * rotations[1][0];
+    if(dot < 0)
+    {
+      for(auto &value: rotations[1]) value = -value;
+      dot = -dot;
+    }
+
+    double weights[2]{1. - t, t};
+    if(dot < 0.9995)
+    {
+      const auto angle = std::acos(dot);
+      weights[0] = std::sin((1. - t) * angle) / std::sin(angle);
+      weights[1] = std::sin(t * angle) / std::sin(angle);
+    }
+
+    double quaternion[4];
+    for(int i = 0; i < 4; ++i) quaternion[i] = weights[0] * rotations[0][i] + weights[1] * rotations[1][i];
+
+    const auto norm = std::sqrt(quaternion[0] * quaternion[0] + vtkMath::Dot(quaternion + 1, quaternion + 1));
+    for(auto &value: quaternion) value /= norm;
+
+    double rotation[3][3];
+    vtkMath::QuaternionToMatrix3x3(quaternion, rotation);
+
+    for(int i = 0; i < 3; ++i)
+    {
+      for(int j = 0; j < 3; ++j) result[4*i+j] = rotation[i][j] * ((1. - t) * scales[0][j] + t * scales[1][j]);
+      result[4*i+3] = (1. - t) * from[4*i+3] + t * to[4*i+3];
+    }
+
+    result[12] = result[13] = result[14] = 0;
+    result[15] = 1;
+  }
+}
+
+//--------------------------------------------------------------------
+void Timeline::track(vtkProp3D *prop)
+{
+  if(!prop) return;
+
+  Entry entry;
+  entry.prop  = prop;
+  entry.user  = prop->GetUserMatrix();
+  entry.valid = false;
+
+  m_entries << entry;
+}
+
+//--------------------------------------------------------------------
+void Timeline::clear()
+{
+  restore();
+
+  m_entries.clear();
+}
+
+//--------------------------------------------------------------------
+void Timeline::advance()
+{
+  for(auto &entry: m_entries)
+  {
+    // the script can set its own user matrix between frames.
+    entry.user = entry.prop->GetUserMatrix();
+
+    const auto last = state(entry);
+    entry.previous = entry.valid ? entry.current : last;
+    entry.current  = last;
+    entry.valid    = true;
+  }
+}
+
+//--------------------------------------------------------------------
+bool Timeline::isStill() const
+{
+  for(auto &entry: m_entries)
+  {
+    if(entry.previous.opacity != entry.current.opacity) return false;
+    if(std::memcmp(entry.previous.matrix, entry.current.matrix, sizeof(entry.current.matrix)) != 0) return false;
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------
+void Timeline::apply(const double t)
+{
+  for(auto &entry: m_entries)
+  {
+    double target[16], inverse[16], delta[16];
+    interpolate(entry.previous.matrix, entry.current.matrix, t, target);
+
+    // prop matrix is the user matrix times its own transformation, the user matrix that gives the target is
+    // the target times the inverse of the last frame matrix times the script user matrix.
+    vtkMatrix4x4::Invert(entry.current.matrix, inverse);
+    vtkMatrix4x4::Multiply4x4(target, inverse, delta);
+
+    auto matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    if(entry.user)
+    {
+      vtkMatrix4x4::Multiply4x4(delta, entry.user->GetData(), matrix->GetData());
+    }
+    else
+    {
+      matrix->DeepCopy(delta);
+    }
+
+    matrix->Modified();
+    entry.prop->SetUserMatrix(matrix);
+
+    auto actor = vtkActor::SafeDownCast(entry.prop);
+    if(actor) actor->GetProperty()->SetOpacity((1. - t) * entry.previous.opacity + t * entry.current.opacity);
+  }
+}
+
+//--------------------------------------------------------------------
+void Timeline::restore()
+{
+  for(auto &entry: m_entries)
+  {
+    if(!entry.valid) continue;
+
+    // the last frame state is restored exactly, not interpolated.
+    entry.prop->SetUserMatrix(entry.user);
+
+    auto actor = vtkActor::SafeDownCast(entry.prop);
+    if(actor) actor->GetProperty()->SetOpacity(entry.current.opacity);
+  }
+}
+
+//--------------------------------------------------------------------
+Timeline::State Timeline::state(const Entry &entry)
+{
+  State result;
+  entry.prop->GetMatrix(result.matrix);
+
+  auto actor = vtkActor::SafeDownCast(entry.prop);
+  result.opacity = actor ? actor->GetProperty()->GetOpacity() : 1.;
+
+  return result;
+}
@@ -0,0 +1,112 @@
+/*
+ File: Timeline.h
+ Created on: 18/10/2026
+ Author: agent
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TIMELINE_H_
+#define TIMELINE_H_
+
+// VTK
+#include <vtkSmartPointer.h>
+
+// Qt
+#include <QList>
+
+class vtkMatrix4x4;
+class vtkProp3D;
+
+/** \class Timeline
+ * \brief Keeps the state of the animated props in the last two frames of the script and moves the props to
+ * any position between them, so the frame interval can be sampled for motion blur. The transformation of the
+ * props is interpolated with the rotation as a quaternion and the opacity of the actors linearly. The props are
+ * moved using their user matrix, so restoring them is exact.
+ *
+ */
+class Timeline
+{
+  public:
+    /** \brief Timeline class constructor.
+     *
+     */
+    Timeline()
+    {}
+
+    /** \brief Tracks the state of the given prop.
+     * \param[in] prop animated prop.
+     *
+     */
+    void track(vtkProp3D *prop);
+
+    /** \brief Restores the props and stops tracking them.
+     *
+     */
+    void clear();
+
+    /** \brief Records the current state of the props as the last frame, the previous last frame becomes the
+     * start of the interval.
+     *
+     */
+    void advance();
+
+    /** \brief Returns true if the props didn't change in the last frame interval.
+     *
+     */
+    bool isStill() const;
+
+    /** \brief Moves the props to the given position of the last frame interval.
+     * \param[in] t interval position, 0 is the previous frame and 1 the last one.
+     *
+     */
+    void apply(const double t);
+
+    /** \brief Restores the props to the state of the last frame.
+     *
+     */
+    void restore();
+
+  private:
+    /** \brief State of a prop in a frame.
+     *
+     */
+    struct State
+    {
+      double matrix[16]; /** prop matrix, including the user matrix. */
+      double opacity;    /** actor opacity or 1 if not an actor.     */
+    };
+
+    /** \brief Tracked prop and its states.
+     *
+     */
+    struct Entry
+    {
+      vtkSmartPointer<vtkProp3D>    prop;     /** tracked prop.                                 */
+      vtkSmartPointer<vtkMatrix4x4> user;     /** user matrix of the script or nullptr.         */
+      State                         previous; /** state in the previous frame.                  */
+      State                         current;  /** state in the last frame.                      */
+      bool                          valid;    /** true if the previous state has been recorded. */
+    };
+
+    /** \brief Returns the current state of the given prop.
+     * \param[in] entry prop entry.
+     *
+     */
+    static State state(const Entry &entry);
+
+    QList<Entry> m_entries; /** tracked props. */
+};
+
+#endif // TIMELINE_H_
@@ -0,0 +1,290 @@
+/*
+ File: TranslucencySorter.cpp
+ Created on: 18/10/2026
+ Author: agent
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Project
+#include "TranslucencySorter.h"
+#include "Utils.h"
+
+// VTK
+#include <vtkActor.h>
+#include <vtkAlgorithm.h>
+#include <vtkAlgorithmOutput.h>
+#include <vtkCallbackCommand.h>
+#include <vtkCamera.h>
+#include <vtkCellArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkLODActor.h>
+#include <vtkMath.h>
+#include <vtkMapperCollection.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataMapper.h>
+#include <vtkRenderer.h>
+#include <vtkTriangleFilter.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+  const int MAX_CACHED_ORDERS = 32; /** maximum number of bucket orders cached per actor. */
+}
+
+//--------------------------------------------------------------------
+TranslucencySorter::TranslucencySorter(const int subdivisions)
+: m_subdivisions{std::max(1, subdivisions)}
+, m_sorts       {0}
+{
+  m_command = vtkSmartPointer<vtkCallbackCommand>::New();
+  m_command->SetClientData(this);
+  m_command->SetCallback(onStartEvent);
+}
+
+//--------------------------------------------------------------------
+TranslucencySorter::~TranslucencySorter()
+{
+  clear();
+}
+
+//--------------------------------------------------------------------
+void TranslucencySorter::add(vtkRenderer *renderer, vtkActor *actor)
+{
+  if(!renderer || !actor) return;
+
+  // the levels of detail are drawn instead of the mapper while interacting, they are sorted too.
+  QList<vtkPolyDataMapper *> mappers{vtkPolyDataMapper::SafeDownCast(actor->GetMapper())};
+
+  auto lodActor = vtkLODActor::SafeDownCast(actor);
+  if(lodActor)
+  {
+    auto collection = lodActor->GetLODMappers();
+    collection->InitTraversal();
+    while(auto mapper = collection->GetNextItem())
+    {
+      mappers << vtkPolyDataMapper::SafeDownCast(mapper);
+    }
+  }
+
+  for(auto mapper: mappers)
+  {
+    if(!mapper || !mapper->GetInputConnection(0, 0)) continue;
+
+    Entry entry;
+    entry.renderer   = renderer;
+    entry.actor      = actor;
+    entry.mapper     = mapper;
+    entry.input      = mapper->GetInputConnection(0, 0);
+    entry.sorted     = vtkSmartPointer<vtkPolyData>::New();
+    entry.source     = nullptr;
+    entry.sourceTime = 0;
+    entry.bucket     = -1;
+    entry.observer   = 0;
+
+    // one observer per renderer updates all its actors.
+    auto observed = std::any_of(m_entries.constBegin(), m_entries.constEnd(), [renderer](const Entry &other) { return other.renderer == renderer; });
+    if(!observed) entry.observer = renderer->AddObserver(vtkCommand::StartEvent, m_command);
+
+    mapper->SetInputData(entry.sorted);
+
+    m_entries << entry;
+  }
+}
+
+//--------------------------------------------------------------------
+void TranslucencySorter::clear()
+{
+  for(auto &entry: m_entries)
+  {
+    entry.mapper->SetInputConnection(entry.input);
+
+    if(entry.observer != 0) entry.renderer->RemoveObserver(entry.observer);
+  }
+
+  m_entries.clear();
+  m_sorts = 0;
+}
+
+//--------------------------------------------------------------------
+void TranslucencySorter::update(Entry &entry)
+{
+  auto producer = entry.input->GetProducer();
+  const auto port = entry.input->GetIndex();
+  producer->Update(port);
+
+  auto source = vtkPolyData::SafeDownCast(producer->GetOutputDataObject(port));
+  if(!source || !source->GetPoints()) return;
+
+  const auto changed = (source != entry.source || source->GetMTime() != entry.sourceTime);
+  if(changed)
+  {
+    // strips can't be reordered by triangle.
+    entry.triangles = source;
+    if(source->GetNumberOfStrips() > 0)
+    {
+      auto triangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
+      triangleFilter->SetInputData(source);
+      triangleFilter->PassVertsOff();
+      triangleFilter->PassLinesOff();
+      triangleFilter->Update();
+
+      entry.triangles = triangleFilter->GetOutput();
+    }
+  }
+
+  const auto polys = entry.triangles->GetPolys()->GetData();
+  const auto ids   = polys->GetPointer(0);
+  const auto count = entry.triangles->GetPolys()->GetNumberOfCells();
+
+  if(changed)
+  {
+    entry.offsets.resize(count);
+    vtkIdType offset = 0;
+    for(vtkIdType i = 0; i < count; ++i)
+    {
+      entry.offsets[i] = offset;
+      offset += ids[offset] + 1;
+    }
+
+    entry.centroids.resize(3 * count);
+    auto points = entry.triangles->GetPoints();
+    parallelFor(0, count, [&](const long long first, const long long last)
+    {
+      double point[3];
+      for(auto i = first; i < last; ++i)
+      {
+        const auto cell = ids + entry.offsets[i];
+
+        double centroid[3]{0, 0, 0};
+        for(vtkIdType j = 1; j <= cell[0]; ++j)
+        {
+          points->GetPoint(cell[j], point);
+          for(int k: {0,1,2}) centroid[k] += point[k];
+        }
+
+        for(int k: {0,1,2}) entry.centroids[3*i+k] = centroid[k] / std::max<vtkIdType>(1, cell[0]);
+      }
+    });
+
+    entry.sorted->ShallowCopy(entry.triangles);
+    entry.source     = source;
+    entry.sourceTime = source->GetMTime();
+    entry.bucket     = -1;
+    entry.orders.clear();
+    entry.history.clear();
+  }
+
+  // view direction in the actor coordinates.
+  double direction[4]{0, 0, 0, 0};
+  entry.renderer->GetActiveCamera()->GetDirectionOfProjection(direction);
+
+  auto inverse = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Invert(entry.actor->GetMatrix(), inverse);
+  inverse->MultiplyPoint(direction, direction);
+
+  double center[3];
+  const auto current = bucket(direction, center);
+  if(current == entry.bucket) return;
+
+  if(!entry.orders.contains(current))
+  {
+    // back to front is descending depth along the view direction.
+    std::vector<float> keys(count);
+    parallelFor(0, count, [&](const long long first, const long long last)
+    {
+      for(auto i = first; i < last; ++i)
+      {
+        const auto centroid = entry.centroids.data() + 3*i;
+        keys[i] = -static_cast<float>(centroid[0] * center[0] + centroid[1] * center[1] + centroid[2] * center[2]);
+      }
+    });
+
+    entry.orders.insert(current, radixSortIndices(keys.data(), static_cast<unsigned int>(count)));
+    ++m_sorts;
+
+    if(entry.history.size() >= MAX_CACHED_ORDERS) entry.orders.remove(entry.history.takeFirst());
+  }
+
+  entry.history.removeOne(current);
+  entry.history << current;
+
+  const auto &order = entry.orders[current];
+
+  auto sortedIds = vtkSmartPointer<vtkIdTypeArray>::New();
+  sortedIds->SetNumberOfValues(polys->GetNumberOfValues());
+  auto output = sortedIds->GetPointer(0);
+  for(vtkIdType i = 0; i < count; ++i)
+  {
+    const auto cell = ids + entry.offsets[order[i]];
+    const auto size = cell[0] + 1;
+
+    std::memcpy(output, cell, size * sizeof(vtkIdType));
+    output += size;
+  }
+
+  auto cells = vtkSmartPointer<vtkCellArray>::New();
+  cells->SetCells(count, sortedIds);
+
+  entry.sorted->SetPolys(cells);
+  entry.bucket = current;
+}
+
+//--------------------------------------------------------------------
+int TranslucencySorter::bucket(const double direction[3], double center[3]) const
+{
+  int axis = 0;
+  for(int i: {1,2})
+  {
+    if(std::abs(direction[i]) > std::abs(direction[axis])) axis = i;
+  }
+
+  const auto major = std::max(std::abs(direction[axis]), 1e-12);
+  const int  face  = 2 * axis + (direction[axis] < 0 ? 1 : 0);
+  const int  u     = (axis + 1) % 3;
+  const int  v     = (axis + 2) % 3;
+
+  auto cellIndex = [this](const double value)
+  { return std::min(m_subdivisions - 1, std::max(0, static_cast<int>((value + 1.) / 2. * m_subdivisions))); };
+
+  const auto iu = cellIndex(direction[u] / major);
+  const auto iv = cellIndex(direction[v] / major);
+
+  center[axis] = direction[axis] < 0 ? -1. : 1.;
+  center[u]    = (iu + 0.5) / m_subdivisions * 2. - 1.;
+  center[v]    = (iv + 0.5) / m_subdivisions * 2. - 1.;
+  vtkMath::Normalize(center);
+
+  return (face * m_subdivisions + iu) * m_subdivisions + iv;
+}
+
+//--------------------------------------------------------------------
+void TranslucencySorter::onStartEvent(vtkObject *caller, unsigned long eventId, void *clientData, void *callData)
+{
+  auto sorter   = static_cast<TranslucencySorter *>(clientData);
+  auto renderer = vtkRenderer::SafeDownCast(caller);
+
+  if(!sorter || !renderer) return;
+
+  for(auto &entry: sorter->m_entries)
+  {
+    if(entry.renderer == renderer && entry.actor->GetVisibility()) sorter->update(entry);
+  }
+}
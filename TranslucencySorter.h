@@ -0,0 +1,127 @@
+/*
+ File: TranslucencySorter.h
+ Created on: 18/10/2026
+ Author: agent
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRANSLUCENCYSORTER_H_
+#define TRANSLUCENCYSORTER_H_
+
+// VTK
+#include <vtkSmartPointer.h>
+
+// Qt
+#include <QList>
+#include <QMap>
+
+// C++
+#include <vector>
+
+class vtkActor;
+class vtkAlgorithmOutput;
+class vtkCallbackCommand;
+class vtkObject;
+class vtkPolyData;
+class vtkPolyDataMapper;
+class vtkRenderer;
+
+/** \class TranslucencySorter
+ * \brief Sorts the polygons of translucent actors back to front before each render. The view direction in the
+ * actor coordinates is quantized in buckets over the faces of a cube, the polygons are sorted along the center
+ * direction of the bucket and the order is cached per bucket, so they are sorted again only when the camera or
+ * actor rotation leaves the bucket. The levels of detail of LOD actors are sorted too.
+ *
+ */
+class TranslucencySorter
+{
+  public:
+    /** \brief TranslucencySorter class constructor.
+     * \param[in] subdivisions number of buckets along each side of the cube faces.
+     *
+     */
+    explicit TranslucencySorter(const int subdivisions = 8);
+
+    /** \brief TranslucencySorter class destructor. Restores the mappers inputs.
+     *
+     */
+    ~TranslucencySorter();
+
+    /** \brief Sorts the polygons of the given actor when the given renderer renders. The input of the mapper
+     * and the level of detail mappers is replaced by the sorted polygons.
+     * \param[in] renderer renderer of the actor.
+     * \param[in] actor translucent actor.
+     *
+     */
+    void add(vtkRenderer *renderer, vtkActor *actor);
+
+    /** \brief Restores the mappers inputs and stops sorting.
+     *
+     */
+    void clear();
+
+    /** \brief Returns the number of sorts done since the last clear.
+     *
+     */
+    unsigned long long sorts() const
+    { return m_sorts; }
+
+  private:
+    /** \brief Sorting state of an actor.
+     *
+     */
+    struct Entry
+    {
+      vtkSmartPointer<vtkRenderer>         renderer;   /** renderer of the actor.                             */
+      vtkSmartPointer<vtkActor>            actor;      /** sorted actor.                                      */
+      vtkSmartPointer<vtkPolyDataMapper>   mapper;     /** sorted mapper, of the actor or one of its LODs.    */
+      vtkSmartPointer<vtkAlgorithmOutput>  input;      /** original mapper input connection.                  */
+      vtkSmartPointer<vtkPolyData>         sorted;     /** mapper input, source with the polygons reordered.  */
+      vtkPolyData                         *source;     /** last source sorted.                                */
+      vtkSmartPointer<vtkPolyData>         triangles;  /** source with the strips converted to triangles.     */
+      unsigned long                        sourceTime; /** modification time of the source when sorted.       */
+      std::vector<vtkIdType>               offsets;    /** offset of each polygon in the source connectivity. */
+      std::vector<float>                   centroids;  /** centroid of each polygon, x y z.                   */
+      QMap<int, std::vector<unsigned int>> orders;     /** back to front polygon order by bucket.             */
+      QList<int>                           history;    /** cached buckets, most recently used last.           */
+      int                                  bucket;     /** bucket of the current order or -1.                 */
+      unsigned long                        observer;   /** observer tag in the renderer or 0.                 */
+    };
+
+    /** \brief Updates the sorted polygons of the given entry for the current view.
+     * \param[in] entry actor entry.
+     *
+     */
+    void update(Entry &entry);
+
+    /** \brief Returns the bucket of the given direction and its center direction.
+     * \param[in] direction view direction.
+     * \param[out] center center direction of the bucket.
+     *
+     */
+    int bucket(const double direction[3], double center[3]) const;
+
+    /** \brief Start render event callback, updates the entries of the renderer.
+     *
+     */
+    static void onStartEvent(vtkObject *caller, unsigned long eventId, void *clientData, void *callData);
+
+    int                                 m_subdivisions; /** buckets along each side of the cube faces. */
+    QList<Entry>                        m_entries;      /** sorted actors.                              */
+    vtkSmartPointer<vtkCallbackCommand> m_command;      /** start render event observer.                */
+    unsigned long long                  m_sorts;        /** number of sorts done.                       */
+};
+
+#endif // TRANSLUCENCYSORTER_H_
@@ -20,28 +20,221 @@
 
 // Project
 #include "Utils.h"
+#include "ResourceCache.h"
 
 // VTK
 #include <vtkImageBlend.h>
 #include <vtkImageData.h>
 #include <vtkImageWriter.h>
-#include <vtkMarchingCubes.h>
-#include <vtkPolyDataNormals.h>
-#include <vtkSmoothPolyDataFilter.h>
+#include <vtkFlyingEdges3D.h>
 #include <vtkCleanPolyData.h>
+#include <vtkTriangleFilter.h>
+#include <vtkStripper.h>
+#include <vtkIdTypeArray.h>
+#include <vtkPolyDataNormals.h>
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
 #include <vtkMetaImageWriter.h>
 #include <vtkXMLPolyDataWriter.h>
 #include <vtkPNGWriter.h>
+#include <vtkMetaImageReader.h>
+#include <vtkDataArray.h>
+#include <vtkPointData.h>
+#include <vtkCommand.h>
 
 // Qt
 #include <QApplication>
 #include <QDir>
 #include <QDebug>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QMutex>
 
 // C++
 #include <cstring>
+#include <cmath>
+#include <limits>
 #include <iostream>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+  QMutex              s_mappingsMutex; /** protects the mappings map.                         */
+  QMap<void *, QFile*> s_mappings;      /** mapped data pointer to file that owns the mapping. */
+
+  QMutex                                     s_ownersMutex; /** protects the owners map.                  */
+  QMultiMap<void *, std::function<void()>>   s_owners;      /** wrapped data pointer to owner release. */
+
+  /** \brief Free function of the wrapped arrays, releases the owner of the data.
+   * \param[in] data Wrapped data pointer.
+   *
+   */
+  void releaseOwner(void *data)
+  {
+    std::function<void()> release;
+
+    {
+      QMutexLocker lock(&s_ownersMutex);
+
+      auto it = s_owners.find(data);
+      if(it == s_owners.end()) return;
+
+      release = it.value();
+      s_owners.erase(it);
+    }
+
+    if(release) release();
+  }
+
+  /** \brief Free function of the mapped arrays, unmaps the data and closes the file.
+   * \param[in] data Mapped data pointer.
+   *
+   */
+  void releaseMapping(void *data)
+  {
+    QMutexLocker lock(&s_mappingsMutex);
+
+    auto file = s_mappings.take(data);
+    if(file)
+    {
+      file->unmap(static_cast<uchar *>(data));
+      file->close();
+      delete file;
+    }
+  }
+
+  /** \brief Returns the VTK data type of the given MetaImage element type or -1 if unknown.
+   * \param[in] type MetaImage element type.
+   *
+   */
+  int metaImageType(const QString &type)
+  {
+    if(type == "MET_CHAR")   return VTK_SIGNED_CHAR;
+    if(type == "MET_UCHAR")  return VTK_UNSIGNED_CHAR;
+    if(type == "MET_SHORT")  return VTK_SHORT;
+    if(type == "MET_USHORT") return VTK_UNSIGNED_SHORT;
+    if(type == "MET_INT")    return VTK_INT;
+    if(type == "MET_UINT")   return VTK_UNSIGNED_INT;
+    if(type == "MET_FLOAT")  return VTK_FLOAT;
+    if(type == "MET_DOUBLE") return VTK_DOUBLE;
+
+    return -1;
+  }
+
+  /** \brief Returns the image mapped from the raw data of the given MetaImage header or nullptr if the data can't be mapped.
+   * \param[in] filename MetaImage (.mhd) header file name.
+   *
+   */
+  vtkSmartPointer<vtkImageData> mapMetaImage(const QString &filename)
+  {
+    QFile header{filename};
+    if(!header.open(QIODevice::ReadOnly)) return nullptr;
+
+    int dims[3]{1,1,1}, nDims = 3, components = 1, type = -1;
+    double spacing[3]{1,1,1}, origin[3]{0,0,0};
+    qint64 headerSize = 0;
+    bool msb = false;
+    QString dataFile;
+
+    while(!header.atEnd() && dataFile.isEmpty())
+    {
+      auto line = QString::fromLatin1(header.readLine()).trimmed();
+      auto separator = line.indexOf('=');
+      if(separator == -1) continue;
+
+      auto key    = line.left(separator).trimmed();
+      auto value  = line.mid(separator + 1).trimmed();
+      auto values = value.split(' ', QString::SkipEmptyParts);
+
+      if(key == "NDims")
+      {
+        nDims = value.toInt();
+      }
+      else if(key == "DimSize")
+      {
+        for(int i = 0; i < std::min(3, values.size()); ++i) dims[i] = values.at(i).toInt();
+      }
+      else if(key == "ElementSpacing" || (key == "ElementSize" && spacing[0] == 1 && spacing[1] == 1 && spacing[2] == 1))
+      {
+        for(int i = 0; i < std::min(3, values.size()); ++i) spacing[i] = values.at(i).toDouble();
+      }
+      else if(key == "Offset" || key == "Origin" || key == "Position")
+      {
+        for(int i = 0; i < std::min(3, values.size()); ++i) origin[i] = values.at(i).toDouble();
+      }
+      else if(key == "ElementType")
+      {
+        type = metaImageType(value);
+      }
+      else if(key == "ElementNumberOfChannels")
+      {
+        components = value.toInt();
+      }
+      else if(key == "HeaderSize")
+      {
+        headerSize = value.toLongLong();
+      }
+      else if(key == "BinaryDataByteOrderMSB" || key == "ElementByteOrderMSB")
+      {
+        msb = (value.compare("True", Qt::CaseInsensitive) == 0);
+      }
+      else if(key == "CompressedData")
+      {
+        if(value.compare("True", Qt::CaseInsensitive) == 0) return nullptr;
+      }
+      else if(key == "ElementDataFile")
+      {
+        dataFile = value;
+      }
+    }
+
+    if(type == -1 || nDims < 2 || nDims > 3 || components < 1 || dataFile.isEmpty()) return nullptr;
+
+    // data file lists and file patterns are left to the reader.
+    if(dataFile.startsWith("LIST") || dataFile.contains(' ')) return nullptr;
+
+    if(msb && (Q_BYTE_ORDER == Q_LITTLE_ENDIAN) && vtkAbstractArray::GetDataTypeSize(type) > 1) return nullptr;
+
+    if(nDims == 2) dims[2] = 1;
+
+    const vtkIdType tuples = static_cast<vtkIdType>(dims[0]) * dims[1] * dims[2];
+    const qint64 dataSize  = tuples * components * vtkAbstractArray::GetDataTypeSize(type);
+
+    QString rawFile;
+    qint64 offset = 0;
+    if(dataFile == "LOCAL")
+    {
+      rawFile = filename;
+      offset  = (headerSize == -1) ? header.size() - dataSize : header.pos();
+    }
+    else
+    {
+      rawFile = QFileInfo{filename}.absoluteDir().absoluteFilePath(dataFile);
+      offset  = (headerSize == -1) ? QFileInfo{rawFile}.size() - dataSize : headerSize;
+    }
+    header.close();
+
+    auto array = mapArray(rawFile, offset, type, components, tuples);
+    if(!array) return nullptr;
+    array->SetName("MetaImage");
+
+    auto image = vtkSmartPointer<vtkImageData>::New();
+    image->SetDimensions(dims);
+    image->SetSpacing(spacing);
+    image->SetOrigin(origin);
+    image->GetPointData()->SetScalars(array);
+
+    return image;
+  }
+}
+
 //--------------------------------------------------------------------
 bool blendPictures(const vtkSmartPointer<vtkImageData> first, const vtkSmartPointer<vtkImageData> second, const int steps, const QString filename)
 {
@@ -69,36 +262,36 @@ bool blendPictures(const vtkSmartPointer<vtkImageData> first, const vtkSmartPoin
 }
 
 //--------------------------------------------------------------------
-vtkSmartPointer<vtkPolyData> imageToMesh(const vtkSmartPointer<vtkImageData> image, const unsigned char value)
+vtkSmartPointer<vtkPolyData> imageToMesh(const vtkSmartPointer<vtkImageData> image, const unsigned char value, const unsigned int iterations, const double relaxation, const bool useCache)
 {
   if(!image) return nullptr;
 
-  // Marching cubes, mesh smoothing.
-  auto surface = vtkSmartPointer<vtkMarchingCubes>::New();
+  ResourceCache cache;
+  QString variant;
+  if(useCache)
+  {
+    variant = QString("isosurface %1 %2 %3 %4").arg(QString::fromLatin1(imageHash(image).toHex())).arg(value).arg(iterations).arg(relaxation);
+
+    auto mesh = cache.mesh(QString(), variant);
+    if(mesh) return mesh;
+  }
+
+  // Flying edges generates each point once, there are no duplicated points to clean.
+  auto surface = vtkSmartPointer<vtkFlyingEdges3D>::New();
   surface->SetInputData(image);
-  surface->SetComputeNormals(true);
+  surface->ComputeNormalsOff();
+  surface->ComputeGradientsOff();
+  surface->ComputeScalarsOff();
   surface->SetValue(0, value);
   surface->Update();
 
-  // Remove any duplicate points.
-  auto cleanFilter = vtkSmartPointer<vtkCleanPolyData>::New();
-  cleanFilter->SetInputData(surface->GetOutput());
-  cleanFilter->Update();
-
-  auto smoothFilter = vtkSmartPointer<vtkSmoothPolyDataFilter>::New();
-  smoothFilter->SetInputConnection(cleanFilter->GetOutputPort());
-  smoothFilter->SetNumberOfIterations(250);
-  smoothFilter->SetRelaxationFactor(0.1);
-  smoothFilter->SetFeatureAngle(95);
-  smoothFilter->SetEdgeAngle(95);
-  smoothFilter->FeatureEdgeSmoothingOn();
-  smoothFilter->BoundarySmoothingOn();
-  smoothFilter->Update();
+  auto smoothed = vtkSmartPointer<vtkPolyData>::New();
+  smoothed->DeepCopy(surface->GetOutput());
+  smoothMesh(smoothed, iterations, relaxation);
 
   auto normalsGenerator = vtkSmartPointer<vtkPolyDataNormals>::New();
-  normalsGenerator->DebugOn();
   normalsGenerator->GlobalWarningDisplayOn();
-  normalsGenerator->SetInputData(smoothFilter->GetOutput());
+  normalsGenerator->SetInputData(smoothed);
   normalsGenerator->ReleaseDataFlagOff();
   normalsGenerator->SetSplitting(1);
   normalsGenerator->SetConsistency(0);
@@ -111,9 +304,131 @@ vtkSmartPointer<vtkPolyData> imageToMesh(const vtkSmartPointer<vtkImageData> ima
   auto data = vtkSmartPointer<vtkPolyData>::New();
   data->DeepCopy(normalsGenerator->GetOutput());
 
+  if(useCache) cache.storeMesh(QString(), variant, data);
+
   return data;
 }
 
+//--------------------------------------------------------------------
+void smoothMesh(vtkPolyData *mesh, const unsigned int iterations, const double relaxation)
+{
+  if(!mesh || !mesh->GetPoints() || iterations == 0) return;
+
+  const auto numPoints = mesh->GetNumberOfPoints();
+
+  // point neighbours from the polygon edges, in compressed rows.
+  std::vector<vtkIdType> offsets(numPoints + 1, 0);
+  std::vector<vtkIdType> neighbours;
+
+  auto polys = mesh->GetPolys();
+  vtkIdType npts;
+  vtkIdType *pts;
+
+  for(polys->InitTraversal(); polys->GetNextCell(npts, pts);)
+  {
+    for(vtkIdType i = 0; i < npts; ++i) offsets[pts[i] + 1] += 2;
+  }
+  for(vtkIdType i = 0; i < numPoints; ++i) offsets[i + 1] += offsets[i];
+
+  neighbours.resize(offsets[numPoints]);
+  auto position = offsets;
+  for(polys->InitTraversal(); polys->GetNextCell(npts, pts);)
+  {
+    for(vtkIdType i = 0; i < npts; ++i)
+    {
+      const auto point = pts[i];
+      neighbours[position[point]++] = pts[(i + 1) % npts];
+      neighbours[position[point]++] = pts[(i + npts - 1) % npts];
+    }
+  }
+
+  // each edge is shared by two polygons, remove repeated neighbours.
+  std::vector<vtkIdType> counts(numPoints, 0);
+  parallelFor(0, numPoints, [&](const long long first, const long long last)
+  {
+    for(auto i = first; i < last; ++i)
+    {
+      auto begin = neighbours.begin() + offsets[i];
+      auto end   = neighbours.begin() + offsets[i + 1];
+      std::sort(begin, end);
+      counts[i] = std::unique(begin, end) - begin;
+    }
+  });
+
+  auto points = vtkSmartPointer<vtkFloatArray>::New();
+  points->DeepCopy(mesh->GetPoints()->GetData());
+
+  std::vector<float> current(points->GetPointer(0), points->GetPointer(0) + 3 * numPoints);
+  std::vector<float> next(current.size());
+  const auto factor = static_cast<float>(relaxation);
+
+  // Laplacian smoothing, each iteration computes the new positions from the previous ones.
+  for(unsigned int iteration = 0; iteration < iterations; ++iteration)
+  {
+    parallelFor(0, numPoints, [&](const long long first, const long long last)
+    {
+      for(auto i = first; i < last; ++i)
+      {
+        const auto count = counts[i];
+        if(count == 0)
+        {
+          for(auto j: {0,1,2}) next[3*i + j] = current[3*i + j];
+          continue;
+        }
+
+        float mean[3]{0,0,0};
+        for(auto k = offsets[i]; k < offsets[i] + count; ++k)
+        {
+          const auto neighbour = neighbours[k];
+          for(auto j: {0,1,2}) mean[j] += current[3*neighbour + j];
+        }
+
+        for(auto j: {0,1,2}) next[3*i + j] = current[3*i + j] + factor * (mean[j]/count - current[3*i + j]);
+      }
+    });
+
+    std::swap(current, next);
+  }
+
+  std::copy(current.begin(), current.end(), points->GetPointer(0));
+
+  auto newPoints = vtkSmartPointer<vtkPoints>::New();
+  newPoints->SetData(points);
+  mesh->SetPoints(newPoints);
+  mesh->Modified();
+}
+
+//--------------------------------------------------------------------
+QByteArray imageHash(vtkImageData *image)
+{
+  QCryptographicHash hash{QCryptographicHash::Sha1};
+
+  auto scalars = image ? image->GetPointData()->GetScalars() : nullptr;
+  if(!scalars) return QByteArray();
+
+  int extent[6];
+  double spacing[3], origin[3];
+  image->GetExtent(extent);
+  image->GetSpacing(spacing);
+  image->GetOrigin(origin);
+
+  const int type = scalars->GetDataType();
+  hash.addData(reinterpret_cast<const char *>(extent), sizeof(extent));
+  hash.addData(reinterpret_cast<const char *>(spacing), sizeof(spacing));
+  hash.addData(reinterpret_cast<const char *>(origin), sizeof(origin));
+  hash.addData(reinterpret_cast<const char *>(&type), sizeof(type));
+
+  const auto size = static_cast<qint64>(scalars->GetNumberOfValues()) * scalars->GetDataTypeSize();
+  const auto data = static_cast<const char *>(scalars->GetVoidPointer(0));
+  const qint64 chunk = 64*1024*1024;
+  for(qint64 offset = 0; offset < size; offset += chunk)
+  {
+    hash.addData(data + offset, static_cast<int>(std::min(chunk, size - offset)));
+  }
+
+  return hash.result();
+}
+
 //--------------------------------------------------------------------
 bool saveImageToDisk(const vtkSmartPointer<vtkImageData>& image, const QString& filename)
 {
@@ -191,3 +506,873 @@ void savePNG(vtkImageData *image, const QString &filename)
   writer->SetFileName(filename.toStdString().c_str());
   writer->Write();
 }
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkDataArray> mapArray(const QString &filename, const qint64 offset, const int type, const int components, const vtkIdType tuples)
+{
+  auto array = vtkSmartPointer<vtkDataArray>::Take(vtkDataArray::CreateDataArray(type));
+  if(!array || components < 1 || tuples < 1 || offset < 0) return nullptr;
+
+  const qint64 size = static_cast<qint64>(tuples) * components * array->GetDataTypeSize();
+
+  auto file = new QFile{filename};
+  if(!file->open(QIODevice::ReadOnly) || file->size() < offset + size)
+  {
+    qDebug() << "mapArray - can't open or invalid size" << filename;
+    delete file;
+    return nullptr;
+  }
+
+  // private mapping, the pages are shared until written, so writing to the array never modifies the file.
+  auto data = file->map(offset, size, QFileDevice::MapPrivateOption);
+  if(!data)
+  {
+    qDebug() << "mapArray - can't map" << filename << file->errorString();
+    delete file;
+    return nullptr;
+  }
+
+  {
+    QMutexLocker lock(&s_mappingsMutex);
+    s_mappings.insert(data, file);
+  }
+
+  // free function must be set after the array, as SetVoidArray() resets it.
+  array->SetNumberOfComponents(components);
+  array->SetVoidArray(data, tuples * components, 0, vtkAbstractArray::VTK_DATA_ARRAY_USER_DEFINED);
+  array->SetArrayFreeFunction(releaseMapping);
+
+  return array;
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> optimizeMesh(vtkPolyData *mesh)
+{
+  if(!mesh || !mesh->GetPoints()) return nullptr;
+
+  auto cleaner = vtkSmartPointer<vtkCleanPolyData>::New();
+  cleaner->SetInputData(mesh);
+  cleaner->PointMergingOn();
+  cleaner->SetTolerance(0.);
+  cleaner->ConvertLinesToPointsOff();
+  cleaner->ConvertPolysToLinesOff();
+  cleaner->ConvertStripsToPolysOff();
+  cleaner->SetOutputPointsPrecision(vtkAlgorithm::SINGLE_PRECISION);
+
+  auto triangles = vtkSmartPointer<vtkTriangleFilter>::New();
+  triangles->SetInputConnection(cleaner->GetOutputPort());
+  triangles->PassVertsOff();
+  triangles->PassLinesOff();
+
+  auto normalsGenerator = vtkSmartPointer<vtkPolyDataNormals>::New();
+  normalsGenerator->SetInputConnection(triangles->GetOutputPort());
+  normalsGenerator->SplittingOff();
+  normalsGenerator->ConsistencyOn();
+  normalsGenerator->ComputePointNormalsOn();
+  normalsGenerator->ComputeCellNormalsOff();
+  normalsGenerator->SetOutputPointsPrecision(vtkAlgorithm::SINGLE_PRECISION);
+  normalsGenerator->Update();
+
+  auto input = normalsGenerator->GetOutput();
+  const auto count = input->GetNumberOfPolys();
+  const auto ids   = input->GetPolys()->GetData()->GetPointer(0);
+
+  // triangles in Morton order of their centroids, 10 bits per axis.
+  double bounds[6];
+  input->GetBounds(bounds);
+
+  auto spread = [](unsigned int value)
+  {
+    value = (value | (value << 16)) & 0x030000FF;
+    value = (value | (value <<  8)) & 0x0300F00F;
+    value = (value | (value <<  4)) & 0x030C30C3;
+    value = (value | (value <<  2)) & 0x09249249;
+    return value;
+  };
+
+  std::vector<unsigned int> codes(count);
+  parallelFor(0, count, [&](const long long first, const long long last)
+  {
+    double point[3];
+    for(auto i = first; i < last; ++i)
+    {
+      double centroid[3]{0, 0, 0};
+      for(int j = 1; j <= 3; ++j)
+      {
+        input->GetPoints()->GetPoint(ids[4*i+j], point);
+        for(int k: {0,1,2}) centroid[k] += point[k] / 3.;
+      }
+
+      unsigned int code = 0;
+      for(int k: {0,1,2})
+      {
+        const auto extent = std::max(bounds[2*k+1] - bounds[2*k], 1e-12);
+        const auto value  = static_cast<unsigned int>(std::min(1023., std::max(0., (centroid[k] - bounds[2*k]) / extent * 1023.)));
+        code |= spread(value) << k;
+      }
+      codes[i] = code;
+    }
+  });
+
+  std::vector<vtkIdType> order(count);
+  for(vtkIdType i = 0; i < count; ++i) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&codes](const vtkIdType a, const vtkIdType b) { return codes[a] < codes[b]; });
+
+  // points renumbered in order of first use.
+  const auto points = input->GetNumberOfPoints();
+  std::vector<vtkIdType> newIds(points, -1);
+  vtkIdType used = 0;
+
+  auto connectivity = vtkSmartPointer<vtkIdTypeArray>::New();
+  connectivity->SetNumberOfValues(4 * count);
+  auto output = connectivity->GetPointer(0);
+  for(auto triangle: order)
+  {
+    *output++ = 3;
+    for(int j = 1; j <= 3; ++j)
+    {
+      auto &id = newIds[ids[4*triangle+j]];
+      if(id == -1) id = used++;
+      *output++ = id;
+    }
+  }
+
+  auto reordered = vtkSmartPointer<vtkPolyData>::New();
+  auto newPoints = vtkSmartPointer<vtkPoints>::New();
+  newPoints->SetDataTypeToFloat();
+  newPoints->SetNumberOfPoints(used);
+  reordered->GetPointData()->CopyAllocate(input->GetPointData(), used);
+  for(vtkIdType i = 0; i < points; ++i)
+  {
+    if(newIds[i] == -1) continue;
+
+    newPoints->SetPoint(newIds[i], input->GetPoint(i));
+    reordered->GetPointData()->CopyData(input->GetPointData(), i, newIds[i]);
+  }
+
+  auto cells = vtkSmartPointer<vtkCellArray>::New();
+  cells->SetCells(count, connectivity);
+
+  reordered->SetPoints(newPoints);
+  reordered->SetPolys(cells);
+
+  auto stripper = vtkSmartPointer<vtkStripper>::New();
+  stripper->SetInputData(reordered);
+  stripper->JoinContiguousSegmentsOff();
+  stripper->Update();
+
+  auto result = vtkSmartPointer<vtkPolyData>::New();
+  result->DeepCopy(stripper->GetOutput());
+
+  return result;
+}
+
+//--------------------------------------------------------------------
+double peakSignalToNoise(vtkImageData *reference, vtkImageData *image)
+{
+  auto first  = reference ? reference->GetPointData()->GetScalars() : nullptr;
+  auto second = image ? image->GetPointData()->GetScalars() : nullptr;
+
+  if(!first || !second || first->GetDataType() != VTK_UNSIGNED_CHAR || second->GetDataType() != VTK_UNSIGNED_CHAR ||
+     first->GetNumberOfValues() != second->GetNumberOfValues() || first->GetNumberOfValues() == 0) return -1;
+
+  const auto values = first->GetNumberOfValues();
+  const auto a      = static_cast<const unsigned char *>(first->GetVoidPointer(0));
+  const auto b      = static_cast<const unsigned char *>(second->GetVoidPointer(0));
+
+  unsigned long long error = 0;
+  for(vtkIdType i = 0; i < values; ++i)
+  {
+    const int difference = static_cast<int>(a[i]) - b[i];
+    error += difference * difference;
+  }
+
+  if(error == 0) return std::numeric_limits<double>::infinity();
+
+  const auto mse = static_cast<double>(error) / values;
+
+  return 10. * std::log10(255. * 255. / mse);
+}
+
+//--------------------------------------------------------------------
+std::vector<unsigned int> radixSortIndices(const float *keys, const unsigned int count)
+{
+  std::vector<unsigned int> bits(count), bitsBuffer(count), order(count), orderBuffer(count);
+
+  // floats to unsigned integers with the same order: negatives are inverted, positives get the sign bit set.
+  parallelFor(0, count, [&](const long long first, const long long last)
+  {
+    for(auto i = first; i < last; ++i)
+    {
+      unsigned int value;
+      std::memcpy(&value, keys + i, sizeof(value));
+
+      bits[i]  = (value & 0x80000000u) ? ~value : (value | 0x80000000u);
+      order[i] = static_cast<unsigned int>(i);
+    }
+  });
+
+  // each block histograms and scatters its contiguous range, the prefix sum keeps the blocks in order.
+  const long long blocks = std::max(1LL, std::min<long long>(std::thread::hardware_concurrency(), count / 65536 + 1));
+  std::vector<std::vector<unsigned int>> histograms(blocks, std::vector<unsigned int>(256));
+
+  for(int shift = 0; shift < 32; shift += 8)
+  {
+    parallelFor(0, blocks, [&](const long long first, const long long last)
+    {
+      for(auto b = first; b < last; ++b)
+      {
+        auto &histogram = histograms[b];
+        std::fill(histogram.begin(), histogram.end(), 0);
+
+        const auto end = count * (b + 1) / blocks;
+        for(auto i = count * b / blocks; i < end; ++i) ++histogram[(bits[i] >> shift) & 0xFF];
+      }
+    });
+
+    unsigned int position = 0;
+    for(int digit = 0; digit < 256; ++digit)
+    {
+      for(auto &histogram: histograms)
+      {
+        const auto value = histogram[digit];
+        histogram[digit] = position;
+        position += value;
+      }
+    }
+
+    parallelFor(0, blocks, [&](const long long first, const long long last)
+    {
+      for(auto b = first; b < last; ++b)
+      {
+        auto &histogram = histograms[b];
+
+        const auto end = count * (b + 1) / blocks;
+        for(auto i = count * b / blocks; i < end; ++i)
+        {
+          const auto index = histogram[(bits[i] >> shift) & 0xFF]++;
+          bitsBuffer[index]  = bits[i];
+          orderBuffer[index] = order[i];
+        }
+      }
+    });
+
+    std::swap(bits, bitsBuffer);
+    std::swap(order, orderBuffer);
+  }
+
+  return order;
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkDataArray> wrapArray(void *data, const int type, const int components, const vtkIdType tuples, std::function<void()> release)
+{
+  auto array = vtkSmartPointer<vtkDataArray>::Take(vtkDataArray::CreateDataArray(type));
+  if(!array || !data || components < 1 || tuples < 1) return nullptr;
+
+  {
+    QMutexLocker lock(&s_ownersMutex);
+    s_owners.insert(data, release);
+  }
+
+  // free function must be set after the array, as SetVoidArray() resets it.
+  array->SetNumberOfComponents(components);
+  array->SetVoidArray(data, tuples * components, 0, vtkAbstractArray::VTK_DATA_ARRAY_USER_DEFINED);
+  array->SetArrayFreeFunction(releaseOwner);
+
+  return array;
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkImageData> loadMetaImage(const QString &filename, vtkCommand *observer)
+{
+  if(!QFileInfo{filename}.exists())
+  {
+    qDebug() << "loadMetaImage - file doesn't exist" << filename;
+    return nullptr;
+  }
+
+  auto image = mapMetaImage(filename);
+
+  if(!image)
+  {
+    auto reader = vtkSmartPointer<vtkMetaImageReader>::New();
+    reader->SetFileName(QDir::toNativeSeparators(filename).toStdString().c_str());
+    if(observer) reader->AddObserver(vtkCommand::ProgressEvent, observer);
+    reader->Update();
+
+    if(reader->GetAbortExecute() || !reader->GetOutput() || !reader->GetOutput()->GetPointData()->GetScalars()) return nullptr;
+
+    image = vtkSmartPointer<vtkImageData>::New();
+    image->DeepCopy(reader->GetOutput());
+  }
+
+  return image;
+}
+
+//--------------------------------------------------------------------
+QString metaImageDataFile(const QString &filename)
+{
+  QFile header{filename};
+  if(!header.open(QIODevice::ReadOnly)) return QString();
+
+  while(!header.atEnd())
+  {
+    auto line = QString::fromLatin1(header.readLine()).trimmed();
+    if(!line.startsWith("ElementDataFile")) continue;
+
+    auto value = line.mid(line.indexOf('=') + 1).trimmed();
+    if(value == "LOCAL") return QFileInfo{filename}.absoluteFilePath();
+    if(value.startsWith("LIST") || value.contains(' ')) return QString();
+
+    return QFileInfo{filename}.absoluteDir().absoluteFilePath(value);
+  }
+
+  return QString();
+}
+//--------------------------------------------------------------------
+void quantizeFlippedRow(const float *input, unsigned char *output, const long long count, const float threshold, const float offset, const float scale)
+{
+  long long i = 0;
+
+#ifdef __SSE2__
+  const auto vThreshold = _mm_set1_ps(threshold);
+  const auto vOffset    = _mm_set1_ps(offset);
+  const auto vScale     = _mm_set1_ps(scale);
+  const auto vZero      = _mm_setzero_ps();
+  const auto vMax       = _mm_set1_ps(255.f);
+
+  auto quantize = [&](const float *values)
+  {
+    // load and reverse the four values.
+    auto v = _mm_loadu_ps(values);
+    v = _mm_shuffle_ps(v, v, _MM_SHUFFLE(0,1,2,3));
+
+    auto mask   = _mm_cmpge_ps(v, vThreshold);
+    auto result = _mm_mul_ps(_mm_sub_ps(v, vOffset), vScale);
+    result = _mm_min_ps(_mm_max_ps(result, vZero), vMax);
+
+    return _mm_cvttps_epi32(_mm_and_ps(result, mask));
+  };
+
+  for(; i + 16 <= count; i += 16)
+  {
+    const float *values = input + count - i - 16;
+
+    auto low  = _mm_packs_epi32(quantize(values + 12), quantize(values + 8));
+    auto high = _mm_packs_epi32(quantize(values + 4), quantize(values));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i), _mm_packus_epi16(low, high));
+  }
+#endif
+
+  for(; i < count; ++i)
+  {
+    const auto value  = input[count - 1 - i];
+    const auto result = std::min(255.f, std::max(0.f, (value - offset) * scale));
+
+    output[i] = (value >= threshold) ? static_cast<unsigned char>(result) : 0;
+  }
+}
+
+//--------------------------------------------------------------------
+void fuseRow(const unsigned char *anatomy, const unsigned char *mci, unsigned short *output, const long long count, const FusionRule &rule)
+{
+  long long i = 0;
+
+#ifdef __SSE2__
+  const auto vThreshold = _mm_set1_epi8(static_cast<char>(rule.threshold));
+  const auto vZero      = _mm_setzero_si128();
+  const auto vOne       = _mm_set1_epi8(1);
+
+  for(; i + 16 <= count; i += 16)
+  {
+    const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(anatomy + i));
+    const auto m = _mm_loadu_si128(reinterpret_cast<const __m128i *>(mci + i));
+
+    // unsigned m >= threshold.
+    auto mask = _mm_cmpeq_epi8(_mm_max_epu8(m, vThreshold), m);
+    if(rule.insideAnatomy) mask = _mm_andnot_si128(_mm_cmpeq_epi8(a, vZero), mask);
+
+    // low byte is the selected value and high byte 1 for MCI values.
+    const auto low  = _mm_or_si128(_mm_and_si128(mask, m), _mm_andnot_si128(mask, a));
+    const auto high = _mm_and_si128(mask, vOne);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i), _mm_unpacklo_epi8(low, high));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i + 8), _mm_unpackhi_epi8(low, high));
+  }
+#endif
+
+  for(; i < count; ++i)
+  {
+    const bool useMCI = mci[i] >= rule.threshold && (!rule.insideAnatomy || anatomy[i] != 0);
+
+    output[i] = useMCI ? 256 + mci[i] : anatomy[i];
+  }
+}
+
+//--------------------------------------------------------------------
+void compositeRow(unsigned char *destination, const unsigned char *overlay, const long long pixels)
+{
+  long long i = 0;
+
+#ifdef __SSE2__
+  const auto vZero = _mm_setzero_si128();
+  const auto vOnes = _mm_set1_epi8(-1);
+  const auto vHalf = _mm_set1_epi16(128);
+
+  for(; i + 4 <= pixels; i += 4)
+  {
+    const auto s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(overlay + 4*i));
+    const auto d = _mm_loadu_si128(reinterpret_cast<__m128i *>(destination + 4*i));
+
+    // alpha of each pixel in its four bytes, inverted.
+    auto alpha = _mm_srli_epi32(s, 24);
+    alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 8));
+    alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 16));
+    const auto inverse = _mm_xor_si128(alpha, vOnes);
+
+    // d * (255 - a) / 255 rounded, in 16 bits.
+    auto low  = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, vZero), _mm_unpacklo_epi8(inverse, vZero)), vHalf);
+    auto high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, vZero), _mm_unpackhi_epi8(inverse, vZero)), vHalf);
+    low  = _mm_srli_epi16(_mm_add_epi16(low, _mm_srli_epi16(low, 8)), 8);
+    high = _mm_srli_epi16(_mm_add_epi16(high, _mm_srli_epi16(high, 8)), 8);
+
+    const auto result = _mm_adds_epu8(s, _mm_packus_epi16(low, high));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + 4*i), result);
+  }
+#endif
+
+  for(; i < pixels; ++i)
+  {
+    const auto s     = overlay + 4*i;
+    const auto d     = destination + 4*i;
+    const int  alpha = 255 - s[3];
+
+    for(int c = 0; c < 4; ++c)
+    {
+      const int value = d[c] * alpha + 128;
+      d[c] = static_cast<unsigned char>(std::min(255, s[c] + ((value + (value >> 8)) >> 8)));
+    }
+  }
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkImageData> premultipliedOverlay(vtkImageData *onBlack, vtkImageData *onWhite)
+{
+  if(!onBlack || !onWhite || onBlack->GetScalarType() != VTK_UNSIGNED_CHAR || onWhite->GetScalarType() != VTK_UNSIGNED_CHAR) return nullptr;
+
+  const auto components = onBlack->GetNumberOfScalarComponents();
+  if(components < 3 || components != onWhite->GetNumberOfScalarComponents()) return nullptr;
+
+  int dims[3], whiteDims[3];
+  onBlack->GetDimensions(dims);
+  onWhite->GetDimensions(whiteDims);
+  if(dims[0] != whiteDims[0] || dims[1] != whiteDims[1] || dims[2] != whiteDims[2]) return nullptr;
+
+  auto result = vtkSmartPointer<vtkImageData>::New();
+  result->SetDimensions(dims);
+  result->AllocateScalars(VTK_UNSIGNED_CHAR, 4);
+
+  const auto black  = static_cast<const unsigned char *>(onBlack->GetScalarPointer());
+  const auto white  = static_cast<const unsigned char *>(onWhite->GetScalarPointer());
+  const auto output = static_cast<unsigned char *>(result->GetScalarPointer());
+
+  // over black the color is already premultiplied, the difference with white is the transparency.
+  parallelFor(0, static_cast<long long>(dims[0]) * dims[1] * dims[2], [&](const long long first, const long long last)
+  {
+    for(auto i = first; i < last; ++i)
+    {
+      const auto b = black + i * components;
+      const auto w = white + i * components;
+
+      int transparency = 0;
+      for(int c = 0; c < 3; ++c) transparency = std::max(transparency, w[c] - b[c]);
+
+      const auto alpha = static_cast<unsigned char>(255 - std::min(255, transparency));
+      for(int c = 0; c < 3; ++c) output[4*i+c] = std::min(b[c], alpha);
+      output[4*i+3] = alpha;
+    }
+  });
+
+  return result;
+}
+
+//--------------------------------------------------------------------
+bool compositeOverlay(vtkImageData *frame, vtkImageData *overlay)
+{
+  if(!frame || !overlay || frame->GetScalarType() != VTK_UNSIGNED_CHAR || overlay->GetScalarType() != VTK_UNSIGNED_CHAR) return false;
+  if(frame->GetNumberOfScalarComponents() != 4 || overlay->GetNumberOfScalarComponents() != 4) return false;
+
+  int dims[3], overlayDims[3];
+  frame->GetDimensions(dims);
+  overlay->GetDimensions(overlayDims);
+  if(dims[0] != overlayDims[0] || dims[1] != overlayDims[1] || dims[2] != overlayDims[2]) return false;
+
+  auto output = static_cast<unsigned char *>(frame->GetScalarPointer());
+  auto input  = static_cast<const unsigned char *>(overlay->GetScalarPointer());
+  const long long rowSize = dims[0];
+
+  parallelFor(0, static_cast<long long>(dims[1]) * dims[2], [&](const long long first, const long long last)
+  {
+    const auto offset = 4 * first * rowSize;
+    compositeRow(output + offset, input + offset, (last - first) * rowSize);
+  });
+
+  frame->Modified();
+
+  return true;
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkImageData> resolveSupersampled(vtkImageData *image, const int factor, const bool tent)
+{
+  if(!image || image->GetScalarType() != VTK_UNSIGNED_CHAR || factor < 1) return nullptr;
+
+  int dims[3];
+  image->GetDimensions(dims);
+
+  const int width  = dims[0] / factor;
+  const int height = dims[1] / factor;
+  if(width == 0 || height == 0) return nullptr;
+
+  const auto components = image->GetNumberOfScalarComponents();
+
+  // filter taps relative to the first input pixel of the output pixel, same in both dimensions.
+  std::vector<int>   offsets;
+  std::vector<float> weights;
+  for(int i = (tent ? -factor : 0); i < (tent ? 2 * factor : factor); ++i)
+  {
+    const auto weight = tent ? factor - std::abs(i + 0.5f - factor / 2.f) : 1.f;
+    if(weight <= 0) continue;
+
+    offsets.push_back(i);
+    weights.push_back(weight);
+  }
+
+  float total = 0;
+  for(auto weight: weights) total += weight;
+  for(auto &weight: weights) weight /= total;
+
+  const int taps = static_cast<int>(weights.size());
+  auto clamp = [](const int value, const int maximum) { return std::min(maximum - 1, std::max(0, value)); };
+
+  auto result = vtkSmartPointer<vtkImageData>::New();
+  result->SetDimensions(width, height, 1);
+  result->AllocateScalars(VTK_UNSIGNED_CHAR, components);
+
+  const auto input     = static_cast<const unsigned char *>(image->GetScalarPointer());
+  const auto output    = static_cast<unsigned char *>(result->GetScalarPointer());
+  const auto rowSize   = static_cast<long long>(dims[0]) * components;
+
+  parallelFor(0, height, [&](const long long first, const long long last)
+  {
+    std::vector<float> columns(rowSize);
+
+    for(auto y = first; y < last; ++y)
+    {
+      // vertical pass, weighted sum of the input rows of the output row.
+      std::fill(columns.begin(), columns.end(), 0.f);
+      for(int t = 0; t < taps; ++t)
+      {
+        const auto row    = input + clamp(static_cast<int>(y) * factor + offsets[t], dims[1]) * rowSize;
+        const auto weight = weights[t];
+        long long i = 0;
+
+#ifdef __SSE2__
+        const auto vZero   = _mm_setzero_si128();
+        const auto vWeight = _mm_set1_ps(weight);
+
+        for(; i + 16 <= rowSize; i += 16)
+        {
+          const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+          const auto low   = _mm_unpacklo_epi8(bytes, vZero);
+          const auto high  = _mm_unpackhi_epi8(bytes, vZero);
+          const __m128i words[4]{_mm_unpacklo_epi16(low, vZero), _mm_unpackhi_epi16(low, vZero), _mm_unpacklo_epi16(high, vZero), _mm_unpackhi_epi16(high, vZero)};
+
+          for(int j = 0; j < 4; ++j)
+          {
+            const auto sum = _mm_add_ps(_mm_loadu_ps(&columns[i + 4*j]), _mm_mul_ps(_mm_cvtepi32_ps(words[j]), vWeight));
+            _mm_storeu_ps(&columns[i + 4*j], sum);
+          }
+        }
+#endif
+
+        for(; i < rowSize; ++i) columns[i] += row[i] * weight;
+      }
+
+      // horizontal pass, weighted sum of the columns of each output pixel.
+      auto outputRow = output + y * width * components;
+      for(int x = 0; x < width; ++x)
+      {
+        auto pixel = outputRow + x * components;
+
+#ifdef __SSE2__
+        if(components == 4)
+        {
+          auto sum = _mm_setzero_ps();
+          for(int t = 0; t < taps; ++t)
+          {
+            const auto column = clamp(x * factor + offsets[t], dims[0]);
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(&columns[4 * column]), _mm_set1_ps(weights[t])));
+          }
+
+          const auto rounded = _mm_cvttps_epi32(_mm_min_ps(_mm_add_ps(sum, _mm_set1_ps(0.5f)), _mm_set1_ps(255.f)));
+          const auto packed  = _mm_packus_epi16(_mm_packs_epi32(rounded, rounded), _mm_setzero_si128());
+          const int  value   = _mm_cvtsi128_si32(packed);
+          std::memcpy(pixel, &value, 4);
+          continue;
+        }
+#endif
+
+        for(int c = 0; c < components; ++c)
+        {
+          float sum = 0;
+          for(int t = 0; t < taps; ++t)
+          {
+            sum += columns[clamp(x * factor + offsets[t], dims[0]) * components + c] * weights[t];
+          }
+
+          pixel[c] = static_cast<unsigned char>(std::min(255.f, sum + 0.5f));
+        }
+      }
+    }
+  });
+
+  return result;
+}
+
+//--------------------------------------------------------------------
+void accumulateRow(float *sums, const unsigned char *values, const long long count)
+{
+  long long i = 0;
+
+#ifdef __SSE2__
+  const auto vZero = _mm_setzero_si128();
+
+  for(; i + 16 <= count; i += 16)
+  {
+    const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+    const auto low   = _mm_unpacklo_epi8(bytes, vZero);
+    const auto high  = _mm_unpackhi_epi8(bytes, vZero);
+    const __m128i words[4]{_mm_unpacklo_epi16(low, vZero), _mm_unpackhi_epi16(low, vZero), _mm_unpacklo_epi16(high, vZero), _mm_unpackhi_epi16(high, vZero)};
+
+    for(int j = 0; j < 4; ++j)
+    {
+      _mm_storeu_ps(sums + i + 4*j, _mm_add_ps(_mm_loadu_ps(sums + i + 4*j), _mm_cvtepi32_ps(words[j])));
+    }
+  }
+#endif
+
+  for(; i < count; ++i) sums[i] += values[i];
+}
+
+//--------------------------------------------------------------------
+bool accumulateImage(std::vector<float> &sums, vtkImageData *image)
+{
+  if(!image || image->GetScalarType() != VTK_UNSIGNED_CHAR) return false;
+
+  const auto count = static_cast<long long>(image->GetNumberOfPoints()) * image->GetNumberOfScalarComponents();
+  if(sums.empty()) sums.resize(count, 0.f);
+  if(static_cast<long long>(sums.size()) != count) return false;
+
+  const auto values = static_cast<const unsigned char *>(image->GetScalarPointer());
+  parallelFor(0, count, [&](const long long first, const long long last)
+  {
+    accumulateRow(sums.data() + first, values + first, last - first);
+  });
+
+  return true;
+}
+
+//--------------------------------------------------------------------
+bool averageImage(const std::vector<float> &sums, const int count, vtkImageData *image)
+{
+  if(!image || image->GetScalarType() != VTK_UNSIGNED_CHAR || count < 1) return false;
+
+  const auto size = static_cast<long long>(image->GetNumberOfPoints()) * image->GetNumberOfScalarComponents();
+  if(static_cast<long long>(sums.size()) != size) return false;
+
+  auto values = static_cast<unsigned char *>(image->GetScalarPointer());
+  const auto scale = 1.f / count;
+
+  parallelFor(0, size, [&](const long long first, const long long last)
+  {
+    long long i = first;
+
+#ifdef __SSE2__
+    const auto vScale = _mm_set1_ps(scale);
+    const auto vHalf  = _mm_set1_ps(0.5f);
+
+    auto mean = [&](const long long index)
+    { return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(sums.data() + index), vScale), vHalf)); };
+
+    for(; i + 16 <= last; i += 16)
+    {
+      const auto low  = _mm_packs_epi32(mean(i), mean(i + 4));
+      const auto high = _mm_packs_epi32(mean(i + 8), mean(i + 12));
+
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(values + i), _mm_packus_epi16(low, high));
+    }
+#endif
+
+    for(; i < last; ++i) values[i] = static_cast<unsigned char>(std::min(255.f, sums[i] * scale + 0.5f));
+  });
+
+  image->Modified();
+
+  return true;
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkImageData> fuseVolumes(vtkImageData *anatomy, vtkImageData *mci, const FusionRule &rule)
+{
+  if(!anatomy || !mci || anatomy->GetScalarType() != VTK_UNSIGNED_CHAR || mci->GetScalarType() != VTK_UNSIGNED_CHAR) return nullptr;
+  if(anatomy->GetNumberOfScalarComponents() != 1 || mci->GetNumberOfScalarComponents() != 1) return nullptr;
+
+  int dims[3], mciDims[3];
+  anatomy->GetDimensions(dims);
+  mci->GetDimensions(mciDims);
+  if(dims[0] != mciDims[0] || dims[1] != mciDims[1] || dims[2] != mciDims[2]) return nullptr;
+
+  auto result = vtkSmartPointer<vtkImageData>::New();
+  result->SetDimensions(dims);
+  result->SetSpacing(anatomy->GetSpacing());
+  result->SetOrigin(anatomy->GetOrigin());
+  result->AllocateScalars(VTK_UNSIGNED_SHORT, 1);
+
+  auto anatomyData = static_cast<const unsigned char *>(anatomy->GetScalarPointer());
+  auto mciData     = static_cast<const unsigned char *>(mci->GetScalarPointer());
+  auto output      = static_cast<unsigned short *>(result->GetScalarPointer());
+  const long long sliceSize = static_cast<long long>(dims[0]) * dims[1];
+
+  parallelFor(0, dims[2], [&](const long long first, const long long last)
+  {
+    const auto offset = first * sliceSize;
+    fuseRow(anatomyData + offset, mciData + offset, output + offset, (last - first) * sliceSize, rule);
+  });
+
+  return result;
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkImageData> cropToNonZero(vtkImageData *image, const int margin)
+{
+  auto scalars = image ? image->GetPointData()->GetScalars() : nullptr;
+  if(!scalars) return nullptr;
+
+  int dims[3], bounds[6];
+  double spacing[3], origin[3];
+  image->GetDimensions(dims);
+  image->GetSpacing(spacing);
+  image->GetOrigin(origin);
+
+  const auto components = scalars->GetNumberOfComponents();
+  const auto input      = static_cast<const char *>(scalars->GetVoidPointer(0));
+
+  bool found = false;
+  switch(scalars->GetDataType())
+  {
+    vtkTemplateMacro(found = nonZeroBounds(static_cast<const VTK_TT *>(scalars->GetVoidPointer(0)), dims, components, bounds));
+    default:
+      return image;
+  }
+
+  // an empty image keeps a single voxel.
+  if(!found) std::fill(bounds, bounds + 6, 0);
+
+  int outputDims[3];
+  for(auto i: {0,1,2})
+  {
+    bounds[2*i]     = std::max(0, bounds[2*i] - margin);
+    bounds[2*i + 1] = std::min(dims[i] - 1, bounds[2*i + 1] + margin);
+    outputDims[i]   = bounds[2*i + 1] - bounds[2*i] + 1;
+    origin[i]      += bounds[2*i] * spacing[i];
+  }
+
+  if(outputDims[0] == dims[0] && outputDims[1] == dims[1] && outputDims[2] == dims[2]) return image;
+
+  auto result = vtkSmartPointer<vtkImageData>::New();
+  result->SetDimensions(outputDims);
+  result->SetSpacing(spacing);
+  result->SetOrigin(origin);
+  result->AllocateScalars(scalars->GetDataType(), components);
+
+  const long long voxelSize = static_cast<long long>(components) * scalars->GetDataTypeSize();
+  const long long inRow     = dims[0] * voxelSize;
+  const long long outRow    = outputDims[0] * voxelSize;
+  auto output = static_cast<char *>(result->GetPointData()->GetScalars()->GetVoidPointer(0));
+
+  parallelFor(0, outputDims[2], [&](const long long first, const long long last)
+  {
+    for(auto z = first; z < last; ++z)
+    {
+      for(long long y = 0; y < outputDims[1]; ++y)
+      {
+        const auto source = input + ((z + bounds[4]) * dims[1] + y + bounds[2]) * inRow + bounds[0] * voxelSize;
+        std::memcpy(output + (z * outputDims[1] + y) * outRow, source, outRow);
+      }
+    }
+  });
+
+  return result;
+}
+
+//--------------------------------------------------------------------
+vtkSmartPointer<vtkImageData> downsampleImage(vtkImageData *image, const int factor, const Pooling pooling)
+{
+  auto scalars = image ? image->GetPointData()->GetScalars() : nullptr;
+  if(!scalars || factor < 1) return nullptr;
+
+  int inputDims[3], outputDims[3];
+  double spacing[3], origin[3];
+  image->GetDimensions(inputDims);
+  image->GetSpacing(spacing);
+  image->GetOrigin(origin);
+
+  for(auto i: {0,1,2})
+  {
+    outputDims[i] = (inputDims[i] + factor - 1) / factor;
+    origin[i]    += spacing[i] * (std::min(factor, inputDims[i]) - 1) / 2.;
+    spacing[i]   *= factor;
+  }
+
+  const auto components = scalars->GetNumberOfComponents();
+
+  auto result = vtkSmartPointer<vtkImageData>::New();
+  result->SetDimensions(outputDims);
+  result->SetSpacing(spacing);
+  result->SetOrigin(origin);
+  result->AllocateScalars(scalars->GetDataType(), components);
+
+  auto output = result->GetPointData()->GetScalars()->GetVoidPointer(0);
+
+  switch(scalars->GetDataType())
+  {
+    vtkTemplateMacro(downsample(static_cast<const VTK_TT *>(scalars->GetVoidPointer(0)), inputDims, static_cast<VTK_TT *>(output), outputDims, components, factor, pooling));
+    default:
+      return nullptr;
+  }
+
+  return result;
+}
+
+//--------------------------------------------------------------------
+ImageStatistics imageStatistics(vtkImageData *image, const bool skipZeros)
+{
+  ImageStatistics result;
+
+  auto scalars = image ? image->GetPointData()->GetScalars() : nullptr;
+  if(!scalars) return result;
+
+  const auto count = static_cast<long long>(scalars->GetNumberOfValues());
+
+  switch(scalars->GetDataType())
+  {
+    vtkTemplateMacro(result = computeStatistics(static_cast<const VTK_TT *>(scalars->GetVoidPointer(0)), count, skipZeros));
+    default:
+      break;
+  }
+
+  return result;
+}
@@ -21,17 +21,30 @@
 #define UTILS_H_
 
 // VTK
-#include <itkImageRegionConstIterator.h>
 #include <vtkImageData.h>
 #include <vtkSmartPointer.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkTypeTraits.h>
 
 // Qt
 #include <QString>
+#include <QByteArray>
 
 // C++
 #include <exception>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 class vtkPolyData;
+class vtkDataArray;
+class vtkCommand;
 
 /** \brief Helper method to blend two pictures of the same size producing 'steps' intermediate pictures. Returns
  *         true on success and false otherwise. The output properties are the same that the first input image.
@@ -45,38 +58,603 @@ static bool blendPictures(const vtkSmartPointer<vtkImageData> first,
                           const vtkSmartPointer<vtkImageData> second,
                           const int steps, const QString filename);
 
-/** \brief Print the minimum and maximum values of the given image. The minimum skips 0.
- * \param[in] image itk::Image pointer.
+/** \brief Executes the given function in parallel over the [begin, end) range split in contiguous blocks, one
+ *         block per hardware thread. The calling thread executes the last block.
+ * \param[in] begin first index of the range.
+ * \param[in] end one past the last index of the range.
+ * \param[in] function function object called as function(first, last) for each block.
  *
  */
-template<typename T> void minmax(const typename T::Pointer image)
+template<typename F> void parallelFor(const long long begin, const long long end, F function)
 {
-  auto min = std::numeric_limits<typename T::ValueType>::max();
-  auto max = std::numeric_limits<typename T::ValueType>::min();
+  const auto count = end - begin;
+  if(count <= 0) return;
+
+  const auto threads   = std::max(1LL, std::min<long long>(count, std::thread::hardware_concurrency()));
+  const auto block     = count / threads;
+  const auto remainder = count % threads;
 
-  if(image)
+  std::vector<std::thread> workers;
+  auto first = begin;
+  for(long long i = 0; i < threads; ++i)
   {
-    auto it = itk::ImageRegionConstIterator<T>(image, image->GetLargestPossibleRegion());
-    it.GoToBegin();
-    while(!it.IsAtEnd())
+    const auto last = first + block + (i < remainder ? 1 : 0);
+
+    if(i == threads - 1)
     {
-      if(it.Value() != 0) min = std::min(min, it.Value());
-      max = std::max(max, it.Value());
+      function(first, last);
+    }
+    else
+    {
+      workers.emplace_back(function, first, last);
+    }
 
-      ++it;
+    first = last;
+  }
+
+  for(auto &worker: workers) worker.join();
+}
+
+/** \brief Values statistics of an image: range and histogram.
+ *
+ */
+struct ImageStatistics
+{
+  double                          min       = 0; /** minimum value.                                 */
+  double                          max       = 0; /** maximum value.                                 */
+  double                          first     = 0; /** lower value of the first histogram bin.       */
+  double                          binWidth  = 1; /** width of each histogram bin.                  */
+  std::vector<unsigned long long> histogram;     /** number of values in each bin.                 */
+
+  /** \brief Returns the lower value of the histogram bin where the given fraction of the values is reached.
+   * \param[in] fraction value in [0,1].
+   *
+   */
+  double percentile(const double fraction) const
+  {
+    unsigned long long total = 0;
+    for(auto count: histogram) total += count;
+
+    const auto limit = fraction * total;
+    unsigned long long accumulated = 0;
+    for(size_t i = 0; i < histogram.size(); ++i)
+    {
+      accumulated += histogram[i];
+      if(accumulated >= limit && accumulated > 0) return std::max(min, std::min(max, first + i * binWidth));
     }
+
+    return max;
   }
+};
+
+/** \brief Computes the statistics of the given values of a type up to 16 bits in parallel and a single pass,
+ *         with a histogram bin for each possible value.
+ * \param[in] data values pointer.
+ * \param[in] count number of values.
+ * \param[in] skipZeros true to ignore zero values for the range and the histogram, false otherwise.
+ *
+ */
+template<typename T> ImageStatistics computeStatistics(const T *data, const long long count, const bool skipZeros, const unsigned int, std::true_type)
+{
+  ImageStatistics result;
 
-  std::cout << "image min: " << static_cast<int>(min) << std::endl;
-  std::cout << "image max: " << static_cast<int>(max) << std::endl << std::flush;
+  const auto lowest = static_cast<long long>(std::numeric_limits<T>::lowest());
+  const auto range  = static_cast<long long>(std::numeric_limits<T>::max()) - lowest + 1;
+
+  result.first = lowest;
+  result.histogram.assign(range, 0);
+
+  std::mutex mutex;
+  parallelFor(0, count, [&](const long long begin, const long long end)
+  {
+    std::vector<unsigned long long> histogram(range, 0);
+    for(auto i = begin; i < end; ++i) ++histogram[static_cast<long long>(data[i]) - lowest];
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for(long long i = 0; i < range; ++i) result.histogram[i] += histogram[i];
+  });
+
+  // skipped zeros don't count for the percentiles either.
+  const auto zero = -lowest;
+  if(skipZeros) result.histogram[zero] = 0;
+
+  long long minBin = -1, maxBin = -1;
+  for(long long i = 0; i < range; ++i)
+  {
+    if(result.histogram[i] == 0) continue;
+    if(minBin == -1) minBin = i;
+    maxBin = i;
+  }
+
+  if(minBin != -1)
+  {
+    result.min = lowest + minBin;
+    result.max = lowest + maxBin;
+  }
+
+  return result;
 }
 
-/** \brief Returns a mesh generated from the given image with the given value.
+/** \brief Computes the statistics of the given values of a wider type in parallel, a first pass for the range
+ *         and a second one for a histogram of the given number of bins between the minimum and maximum.
+ * \param[in] data values pointer.
+ * \param[in] count number of values.
+ * \param[in] skipZeros true to ignore zero values for the range and the histogram, false otherwise.
+ * \param[in] bins number of histogram bins.
+ *
+ */
+template<typename T> ImageStatistics computeStatistics(const T *data, const long long count, const bool skipZeros, const unsigned int bins, std::false_type)
+{
+  ImageStatistics result;
+
+  auto minimum = std::numeric_limits<T>::max();
+  auto maximum = std::numeric_limits<T>::lowest();
+
+  std::mutex mutex;
+  parallelFor(0, count, [&](const long long begin, const long long end)
+  {
+    auto localMin = std::numeric_limits<T>::max();
+    auto localMax = std::numeric_limits<T>::lowest();
+    if(skipZeros)
+    {
+      for(auto i = begin; i < end; ++i)
+      {
+        const auto value = data[i];
+        localMin = std::min(localMin, value != 0 ? value : std::numeric_limits<T>::max());
+        localMax = std::max(localMax, value != 0 ? value : std::numeric_limits<T>::lowest());
+      }
+    }
+    else
+    {
+      for(auto i = begin; i < end; ++i)
+      {
+        localMin = std::min(localMin, data[i]);
+        localMax = std::max(localMax, data[i]);
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    minimum = std::min(minimum, localMin);
+    maximum = std::max(maximum, localMax);
+  });
+
+  if(minimum > maximum) return result;
+
+  result.min      = minimum;
+  result.max      = maximum;
+  result.first    = minimum;
+  result.binWidth = (maximum > minimum) ? (static_cast<double>(maximum) - minimum) / bins : 1.;
+  result.histogram.assign(bins, 0);
+
+  parallelFor(0, count, [&](const long long begin, const long long end)
+  {
+    std::vector<unsigned long long> histogram(bins, 0);
+    for(auto i = begin; i < end; ++i)
+    {
+      if(skipZeros && data[i] == 0) continue;
+
+      const auto bin = static_cast<long long>((static_cast<double>(data[i]) - result.first) / result.binWidth);
+      ++histogram[std::max(0LL, std::min<long long>(bins - 1, bin))];
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for(unsigned int i = 0; i < bins; ++i) result.histogram[i] += histogram[i];
+  });
+
+  return result;
+}
+
+/** \brief Computes the statistics of the given values in parallel. Types up to 16 bits get a histogram bin for
+ *         each possible value computed in a single pass, other types get a histogram of 'bins' bins between the
+ *         minimum and maximum.
+ * \param[in] data values pointer.
+ * \param[in] count number of values.
+ * \param[in] skipZeros true to ignore zero values for the range and the histogram, false otherwise.
+ * \param[in] bins number of histogram bins for types wider than 16 bits.
+ *
+ */
+template<typename T> ImageStatistics computeStatistics(const T *data, const long long count, const bool skipZeros, const unsigned int bins = 256)
+{
+  if(!data || count <= 0 || bins == 0) return ImageStatistics();
+
+  using SmallType = std::integral_constant<bool, std::is_integral<T>::value && sizeof(T) <= 2>;
+
+  return computeStatistics(data, count, skipZeros, bins, SmallType());
+}
+
+/** \brief Returns the statistics of the given ITK image buffer.
+ * \param[in] image itk::Image pointer.
+ * \param[in] skipZeros true to ignore zero values for the range and the histogram, false otherwise.
+ *
+ */
+template<typename T> ImageStatistics imageStatistics(const typename T::Pointer image, const bool skipZeros)
+{
+  if(!image) return ImageStatistics();
+
+  const auto count = static_cast<long long>(image->GetBufferedRegion().GetNumberOfPixels()) * image->GetNumberOfComponentsPerPixel();
+
+  return computeStatistics(reinterpret_cast<const typename T::InternalPixelType *>(image->GetBufferPointer()), count, skipZeros);
+}
+
+/** \brief Returns the statistics of the scalars of the given VTK image, all components.
+ * \param[in] image VTK image raw pointer.
+ * \param[in] skipZeros true to ignore zero values for the range and the histogram, false otherwise.
+ *
+ */
+ImageStatistics imageStatistics(vtkImageData *image, const bool skipZeros);
+
+/** \brief Computes the bounds of the non-zero voxels of the given volume buffer, a voxel is non-zero if any of
+ *         its components is. Slices are processed in parallel. Returns false if all voxels are zero.
+ * \param[in] data volume values.
+ * \param[in] dims volume dimensions.
+ * \param[in] components number of components per voxel.
+ * \param[out] bounds minimum and maximum non-zero voxel indexes as [xmin, xmax, ymin, ymax, zmin, zmax].
+ *
+ */
+template<typename T> bool nonZeroBounds(const T *data, const int dims[3], const int components, int bounds[6])
+{
+  const long long rowSize = static_cast<long long>(dims[0]) * components;
+  int result[6]{dims[0], -1, dims[1], -1, dims[2], -1};
+  std::mutex mutex;
+
+  parallelFor(0, dims[2], [&](const long long first, const long long last)
+  {
+    int partial[6]{dims[0], -1, dims[1], -1, dims[2], -1};
+
+    for(auto z = first; z < last; ++z)
+    {
+      for(long long y = 0; y < dims[1]; ++y)
+      {
+        const auto row = data + (z * dims[1] + y) * rowSize;
+
+        long long begin = 0;
+        while(begin < rowSize && row[begin] == 0) ++begin;
+        if(begin == rowSize) continue;
+
+        long long end = rowSize - 1;
+        while(row[end] == 0) --end;
+
+        partial[0] = std::min(partial[0], static_cast<int>(begin / components));
+        partial[1] = std::max(partial[1], static_cast<int>(end / components));
+        partial[2] = std::min(partial[2], static_cast<int>(y));
+        partial[3] = std::max(partial[3], static_cast<int>(y));
+        partial[4] = std::min(partial[4], static_cast<int>(z));
+        partial[5] = std::max(partial[5], static_cast<int>(z));
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for(auto i: {0,2,4}) result[i] = std::min(result[i], partial[i]);
+    for(auto i: {1,3,5}) result[i] = std::max(result[i], partial[i]);
+  });
+
+  std::copy(result, result + 6, bounds);
+
+  return result[1] >= 0;
+}
+
+/** \brief Returns the given image cropped to the bounds of its non-zero voxels plus the given margin, with the
+ *         origin moved so the voxels keep their position. Returns the same image if there's nothing to crop and
+ *         nullptr if the image has no scalars.
+ * \param[in] image VTK image raw pointer.
+ * \param[in] margin number of voxels added around the non-zero bounds.
+ *
+ */
+vtkSmartPointer<vtkImageData> cropToNonZero(vtkImageData *image, const int margin);
+
+/** \brief Block reduction used to downsample images.
+ *
+ */
+enum class Pooling: char { MAXIMUM, AVERAGE };
+
+/** \brief Downsamples the given volume buffer by the given factor in each dimension, each output voxel is the
+ *         maximum or the average of its input block (blocks on the upper borders can be smaller). The output
+ *         slices are computed in parallel.
+ * \param[in] input input values.
+ * \param[in] inputDims input dimensions.
+ * \param[out] output output values, must hold the output dimensions values times the number of components.
+ * \param[in] outputDims output dimensions, the input dimensions divided by the factor rounded up.
+ * \param[in] components number of components per voxel.
+ * \param[in] factor downsampling factor.
+ * \param[in] pooling block reduction.
+ *
+ */
+template<typename T> void downsample(const T *input, const int inputDims[3], T *output, const int outputDims[3],
+                                     const int components, const int factor, const Pooling pooling)
+{
+  const long long inRow   = static_cast<long long>(inputDims[0]) * components;
+  const long long inSlice = inRow * inputDims[1];
+
+  parallelFor(0, outputDims[2], [&](const long long first, const long long last)
+  {
+    std::vector<double> values(components);
+
+    for(auto z = first; z < last; ++z)
+    {
+      const auto z0 = z * factor;
+      const auto z1 = std::min<long long>(z0 + factor, inputDims[2]);
+      auto out = output + z * outputDims[1] * outputDims[0] * components;
+
+      for(long long y = 0; y < outputDims[1]; ++y)
+      {
+        const auto y0 = y * factor;
+        const auto y1 = std::min<long long>(y0 + factor, inputDims[1]);
+
+        for(long long x = 0; x < outputDims[0]; ++x)
+        {
+          const auto x0 = x * factor;
+          const auto x1 = std::min<long long>(x0 + factor, inputDims[0]);
+
+          std::fill(values.begin(), values.end(), pooling == Pooling::MAXIMUM ? std::numeric_limits<double>::lowest() : 0.);
+
+          for(auto k = z0; k < z1; ++k)
+          {
+            for(auto j = y0; j < y1; ++j)
+            {
+              auto in = input + k * inSlice + j * inRow + x0 * components;
+              for(auto i = x0; i < x1; ++i)
+              {
+                for(int c = 0; c < components; ++c, ++in)
+                {
+                  if(pooling == Pooling::MAXIMUM)
+                  {
+                    values[c] = std::max(values[c], static_cast<double>(*in));
+                  }
+                  else
+                  {
+                    values[c] += *in;
+                  }
+                }
+              }
+            }
+          }
+
+          const double count = (z1 - z0) * (y1 - y0) * (x1 - x0);
+          for(int c = 0; c < components; ++c, ++out)
+          {
+            if(pooling == Pooling::MAXIMUM)
+            {
+              *out = static_cast<T>(values[c]);
+            }
+            else
+            {
+              const auto mean = values[c] / count;
+              *out = static_cast<T>(std::is_integral<T>::value ? mean + 0.5 : mean);
+            }
+          }
+        }
+      }
+    }
+  });
+}
+
+/** \brief Returns the given image downsampled by the given factor in each dimension. The output spacing is
+ *         scaled by the factor and the origin moved to the center of the first block, so the volume occupies
+ *         the same space. Returns nullptr if the image has no scalars.
+ * \param[in] image VTK image raw pointer.
+ * \param[in] factor downsampling factor.
+ * \param[in] pooling block reduction, maximum for MIP volumes and average for composite ones.
+ *
+ */
+vtkSmartPointer<vtkImageData> downsampleImage(vtkImageData *image, const int factor, const Pooling pooling);
+
+/** \brief Rule to fuse an anatomy and a MCI volume in a single one. Anatomy values are kept in [0,255] and MCI
+ *         values are moved to [256,511] so a single transfer function can show both.
+ *
+ */
+struct FusionRule
+{
+  unsigned char threshold     = 1;     /** MCI values equal or above this replace the anatomy value.   */
+  bool          insideAnatomy = false; /** true to use MCI values only where the anatomy is not zero. */
+};
+
+/** \brief Fuses a row of anatomy and MCI values with the given rule. Uses SSE2 when available.
+ * \param[in] anatomy anatomy values.
+ * \param[in] mci MCI values.
+ * \param[out] output fused values.
+ * \param[in] count number of values.
+ * \param[in] rule fusion rule.
+ *
+ */
+void fuseRow(const unsigned char *anatomy, const unsigned char *mci, unsigned short *output, const long long count, const FusionRule &rule);
+
+/** \brief Returns the fusion of the given unsigned char anatomy and MCI volumes, computed in parallel, or nullptr
+ *         if the volumes are not unsigned char or have different dimensions. The geometry is the anatomy one.
+ * \param[in] anatomy anatomy volume.
+ * \param[in] mci MCI volume.
+ * \param[in] rule fusion rule.
+ *
+ */
+vtkSmartPointer<vtkImageData> fuseVolumes(vtkImageData *anatomy, vtkImageData *mci, const FusionRule &rule);
+
+/** \brief Quantizes a row of float values to unsigned char writing them in reverse order (output[i] is computed
+ *         from input[count-1-i]). Values below the threshold are 0, the rest are (value - offset) * scale saturated
+ *         to [0,255]. Uses SSE2 when available.
+ * \param[in] input input values.
+ * \param[out] output output values, can't overlap the input.
+ * \param[in] count number of values.
+ * \param[in] threshold values below this are zero.
+ * \param[in] offset value subtracted before scaling.
+ * \param[in] scale scale factor.
+ *
+ */
+void quantizeFlippedRow(const float *input, unsigned char *output, const long long count, const float threshold, const float offset, const float scale);
+
+/** \brief Returns a smoothed mesh with normals generated from the given image with the given value. The result
+ *         is stored in the resources cache keyed by the image contents and parameters and reused if present.
  * \param[in] image vtkImageData smartpointer.
- * \param[in] value Numeric value for the marching cubes.
+ * \param[in] value Numeric value of the isosurface.
+ * \param[in] iterations Number of smoothing iterations.
+ * \param[in] relaxation Smoothing relaxation factor.
+ * \param[in] useCache true to use the resources cache and false otherwise.
+ *
+ */
+vtkSmartPointer<vtkPolyData> imageToMesh(const vtkSmartPointer<vtkImageData> image, const unsigned char value,
+                                         const unsigned int iterations = 250, const double relaxation = 0.1,
+                                         const bool useCache = true);
+
+/** \brief Laplacian smoothing of the given mesh points using the polygon edges, points are processed in parallel.
+ * \param[in] mesh Mesh to smooth.
+ * \param[in] iterations Number of iterations.
+ * \param[in] relaxation Relaxation factor, fraction of the distance to the neighbours mean moved per iteration.
+ *
+ */
+void smoothMesh(vtkPolyData *mesh, const unsigned int iterations, const double relaxation);
+
+/** \brief Returns the given mesh in a compact layout for rendering: float points with duplicates merged,
+ *         precomputed point normals, triangles ordered along a Morton curve with the points renumbered in order of
+ *         first use for vertex cache locality, and joined in triangle strips. Other cells are removed.
+ * \param[in] mesh Mesh to optimize.
+ *
+ */
+vtkSmartPointer<vtkPolyData> optimizeMesh(vtkPolyData *mesh);
+
+/** \brief Returns a data array that uses the given buffer without copying it. The release function is called
+ *         when the array frees the buffer, it usually holds a reference to the buffer owner.
+ * \param[in] data buffer pointer.
+ * \param[in] type VTK data type.
+ * \param[in] components number of components per tuple.
+ * \param[in] tuples number of tuples.
+ * \param[in] release function called when the buffer is no longer used.
+ *
+ */
+vtkSmartPointer<vtkDataArray> wrapArray(void *data, const int type, const int components, const vtkIdType tuples, std::function<void()> release);
+
+/** \brief Returns a VTK image that shares the pixel buffer of the given ITK image, without copying it. The ITK
+ *         image is kept alive until the VTK scalars are released. The extent, origin and spacing are the ITK
+ *         ones, as VTK images can't be oriented the ITK direction is returned as a matrix to be used as the
+ *         user matrix of the prop that renders the image. Returns nullptr if the image has no buffer.
+ * \param[in] image itk::Image pointer.
+ * \param[out] direction matrix to fill with the image direction about its origin or nullptr.
+ *
+ */
+template<typename T> vtkSmartPointer<vtkImageData> itkToVTK(const typename T::Pointer image, vtkMatrix4x4 *direction = nullptr)
+{
+  if(!image || !image->GetBufferPointer()) return nullptr;
+
+  using PixelType = typename T::InternalPixelType;
+
+  const auto region     = image->GetBufferedRegion();
+  const auto index      = region.GetIndex();
+  const auto size       = region.GetSize();
+  const auto components = static_cast<int>(image->GetNumberOfComponentsPerPixel());
+  const auto tuples     = static_cast<vtkIdType>(region.GetNumberOfPixels());
+
+  // the lambda holds a reference to the image until the array releases the buffer.
+  auto owner   = image;
+  auto scalars = wrapArray(image->GetBufferPointer(), vtkTypeTraits<PixelType>::VTKTypeID(), components, tuples, [owner]() {});
+  if(!scalars) return nullptr;
+
+  auto result = vtkSmartPointer<vtkImageData>::New();
+  result->SetExtent(index[0], index[0] + size[0] - 1, index[1], index[1] + size[1] - 1, index[2], index[2] + size[2] - 1);
+  result->SetSpacing(image->GetSpacing()[0], image->GetSpacing()[1], image->GetSpacing()[2]);
+  result->SetOrigin(image->GetOrigin()[0], image->GetOrigin()[1], image->GetOrigin()[2]);
+  result->GetPointData()->SetScalars(scalars);
+
+  if(direction)
+  {
+    // world = origin + D * (point - origin)
+    const auto &matrix = image->GetDirection();
+    const auto &origin = image->GetOrigin();
+
+    direction->Identity();
+    for(int i = 0; i < 3; ++i)
+    {
+      double translation = origin[i];
+      for(int j = 0; j < 3; ++j)
+      {
+        direction->SetElement(i, j, matrix[i][j]);
+        translation -= matrix[i][j] * origin[j];
+      }
+      direction->SetElement(i, 3, translation);
+    }
+  }
+
+  return result;
+}
+
+/** \brief Returns the SHA-1 hash of the given image scalars and geometry or an empty array if there are no scalars.
+ * \param[in] image VTK image raw pointer.
+ *
+ */
+QByteArray imageHash(vtkImageData *image);
+
+/** \brief Returns the peak signal to noise ratio in dB of the second image against the first one, infinity if
+ *         both are equal or a negative value if they are not unsigned char images with the same number of values.
+ * \param[in] reference reference image.
+ * \param[in] image image to compare.
+ *
+ */
+double peakSignalToNoise(vtkImageData *reference, vtkImageData *image);
+
+/** \brief Returns the indices of the given keys in ascending order of the keys. Parallel and stable LSD radix sort
+ *         of the keys bits, 8 bits per pass.
+ * \param[in] keys keys to sort.
+ * \param[in] count number of keys.
+ *
+ */
+std::vector<unsigned int> radixSortIndices(const float *keys, const unsigned int count);
+
+/** \brief Composites a row of premultiplied RGBA overlay pixels over a row of RGBA pixels. Uses SSE2 when
+ *         available.
+ * \param[in] destination RGBA pixels, modified in place.
+ * \param[in] overlay premultiplied RGBA overlay pixels.
+ * \param[in] pixels number of pixels.
+ *
+ */
+void compositeRow(unsigned char *destination, const unsigned char *overlay, const long long pixels);
+
+/** \brief Returns the premultiplied RGBA overlay that, composited over a background, gives the same picture as
+ *         rendering the overlay over it. The alpha is recovered from the overlay rendered over black and over
+ *         white. Returns nullptr if the images are not unsigned char RGB or RGBA images of the same size.
+ * \param[in] onBlack overlay rendered over a black background.
+ * \param[in] onWhite overlay rendered over a white background.
+ *
+ */
+vtkSmartPointer<vtkImageData> premultipliedOverlay(vtkImageData *onBlack, vtkImageData *onWhite);
+
+/** \brief Composites the given premultiplied RGBA overlay over the given RGBA frame, rows in parallel. Returns
+ *         false if the images are not unsigned char RGBA images of the same size.
+ * \param[in] frame RGBA frame, modified in place.
+ * \param[in] overlay premultiplied RGBA overlay.
+ *
+ */
+bool compositeOverlay(vtkImageData *frame, vtkImageData *overlay);
+
+/** \brief Resolves an unsigned char image rendered at the given factor of the output resolution, rows in
+ *         parallel. Uses SSE2 when available. Returns nullptr if the image is not an unsigned char image or is
+ *         smaller than the factor.
+ * \param[in] image supersampled image.
+ * \param[in] factor supersampling factor in each dimension.
+ * \param[in] tent true to use a tent filter of twice the factor width and false to use a box filter.
+ *
+ */
+vtkSmartPointer<vtkImageData> resolveSupersampled(vtkImageData *image, const int factor, const bool tent);
+
+/** \brief Adds the given unsigned char values to the float sums. Uses SSE2 when available.
+ * \param[in] sums accumulated values, modified in place.
+ * \param[in] values values to add.
+ * \param[in] count number of values.
+ *
+ */
+void accumulateRow(float *sums, const unsigned char *values, const long long count);
+
+/** \brief Adds the voxels of the given unsigned char image to the float accumulation buffer, in parallel. The
+ *         buffer is resized to the image size if it's empty. Returns false if the sizes don't match.
+ * \param[in] sums accumulation buffer.
+ * \param[in] image image to add.
+ *
+ */
+bool accumulateImage(std::vector<float> &sums, vtkImageData *image);
+
+/** \brief Writes the mean of the accumulated images in the given unsigned char image, in parallel. Returns
+ *         false if the sizes don't match.
+ * \param[in] sums accumulation buffer.
+ * \param[in] count number of accumulated images.
+ * \param[in] image image of the size of the accumulated images, modified in place.
  *
  */
-vtkSmartPointer<vtkPolyData> imageToMesh(const vtkSmartPointer<vtkImageData> image, const unsigned char value);
+bool averageImage(const std::vector<float> &sums, const int count, vtkImageData *image);
 
 /** \brief Helper to save an image to disk. Returns false if file exists or no valid image is given, returns true otherwise.
  * \param[in] image VTK image smartpointer.
@@ -92,6 +670,35 @@ bool saveImageToDisk(const vtkSmartPointer<vtkImageData> &image, const QString &
  */
 bool saveMeshToDisk(const vtkSmartPointer<vtkPolyData> &mesh, const QString &filename);
 
+/** \brief Returns the image of the given MetaImage header file with its raw data mapped in memory instead of
+ *         read, pages are loaded on demand and shared between processes. Falls back to vtkMetaImageReader if the
+ *         raw data can't be mapped (compressed data, data file lists or non native byte order). Returns nullptr
+ *         on error.
+ * \param[in] filename MetaImage (.mhd) header file name.
+ * \param[in] observer progress event observer of the reader, if used.
+ *
+ */
+vtkSmartPointer<vtkImageData> loadMetaImage(const QString &filename, vtkCommand *observer = nullptr);
+
+/** \brief Returns the absolute path of the raw data file of the given MetaImage header, the header itself if
+ *         the data is local, or an empty string on error.
+ * \param[in] filename MetaImage (.mhd) header file name.
+ *
+ */
+QString metaImageDataFile(const QString &filename);
+
+/** \brief Returns a data array of the given type whose values are a private (copy-on-write) mapping of the
+ *         given file region, no data is copied. The mapping is released when the array is destroyed. Returns
+ *         nullptr on error.
+ * \param[in] filename Name of file on disk.
+ * \param[in] offset Offset of the data in the file in bytes.
+ * \param[in] type VTK data type of the values.
+ * \param[in] components Number of components per tuple.
+ * \param[in] tuples Number of tuples.
+ *
+ */
+vtkSmartPointer<vtkDataArray> mapArray(const QString &filename, const qint64 offset, const int type, const int components, const vtkIdType tuples);
+
 /** \brief Helper to save a 2D image to disk. Does nothing if the input image is 3D.
  * \param[in] image Image to save.
  * \param[in] filename Image filename on disk.